@@ -108,6 +108,24 @@ WEAK void SystemClock_Config(void)
     Error_Handler();
   }
 }
+
+/**
+  * @brief  System Clock Configuration after a wakeup from STOP
+  * @note   LowPower_stop() wakes the core up on MSI, which keeps its range,
+  *         and the regulator scale, bus prescalers and USART clock sources
+  *         survive the stop mode. So there is nothing to configure again
+  *         once MSI is ready, only a changed clock takes the full path.
+  * @retval None
+  */
+void SystemClock_ConfigFromStop(void)
+{
+  if (__HAL_RCC_GET_SYSCLK_SOURCE() == RCC_SYSCLKSOURCE_STATUS_MSI &&
+      __HAL_RCC_GET_MSI_RANGE() == RCC_MSIRANGE_5) {
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_MSIRDY) == RESET);
+    return;
+  }
+  SystemClock_Config();
+}
 #ifdef __cplusplus
 }
 #endif
@@ -44,6 +44,7 @@ STM32LowPower::STM32LowPower()
   _configured = false;
   _serial = NULL;
   _rtc_wakeup = false;
+  _wakeup_period = 0;
 }
 
 /**
@@ -99,6 +100,55 @@ void STM32LowPower::deepSleep(uint32_t ms)
   LowPower_stop(_serial);
 }
 
+/**
+  * @brief  Enable the deepsleep low power mode (STM32 stop) until a time of
+  *         day on the RTC, or an interrupt.
+  * @param  dayMs: wakeup time in milliseconds since midnight of the RTC time.
+  * @retval None
+  */
+void STM32LowPower::deepSleepUntil(uint32_t dayMs)
+{
+  programRtcWakeUpAt(dayMs, DEEP_SLEEP_MODE);
+  LowPower_stop(_serial);
+}
+
+#if defined(RTC_WAKEUP_TIMER)
+/**
+  * @brief  Enable the deepsleep low power mode (STM32 stop) until the next
+  *         period of the RTC wakeup timer, or an interrupt. The timer is only
+  *         programmed when the period changes, it keeps running between the
+  *         calls: the wakeups are ms apart however long the core was awake,
+  *         and the RTC alarm stays free.
+  * @param  ms: period in milliseconds, 0 stops the timer and sleeps until
+  *         an interrupt.
+  * @retval None
+  */
+void STM32LowPower::deepSleepPeriodic(uint32_t ms)
+{
+  if (ms != _wakeup_period) {
+    STM32RTC &rtc = configRtcForLowPower(DEEP_SLEEP_MODE);
+    if (ms != 0) {
+      rtc.enableWakeUpTimer(ms);
+    } else {
+      rtc.disableWakeUpTimer();
+    }
+    _wakeup_period = ms;
+  }
+  LowPower_stop(_serial);
+}
+#endif
+
+/**
+  * @brief  Time the last deepSleep() took to get the clocks running again
+  *         after the wakeup.
+  * @param  None
+  * @retval Latency in microseconds
+  */
+uint32_t STM32LowPower::wakeupLatency(void)
+{
+  return LowPower_wakeupLatency();
+}
+
 /**
   * @brief  Enable the shutdown low power mode (STM32 shutdown or standby mode).
   *          Exit this mode on interrupt or in n milliseconds.
@@ -113,6 +163,18 @@ void STM32LowPower::shutdown(uint32_t ms)
   LowPower_shutdown();
 }
 
+/**
+  * @brief  Enable the shutdown low power mode (STM32 shutdown or standby mode)
+  *         until a time of day on the RTC, or an interrupt.
+  * @param  dayMs: wakeup time in milliseconds since midnight of the RTC time.
+  * @retval None
+  */
+void STM32LowPower::shutdownUntil(uint32_t dayMs)
+{
+  programRtcWakeUpAt(dayMs, SHUTDOWN_MODE);
+  LowPower_shutdown();
+}
+
 /**
   * @brief  Enable GPIO pin in interrupt mode. If the pin is a wakeup pin, it is
   *         configured as wakeup source.
@@ -169,15 +231,12 @@ void STM32LowPower::enableWakeupFrom(STM32RTC *rtc, voidFuncPtr callback, void *
 }
 
 /**
-  * @brief  Configure the RTC alarm
-  * @param  ms: time of the alarm in milliseconds.
+  * @brief  Select an RTC clock source that keeps running in the low power mode
   * @param  lp_mode: low power mode targeted.
-  * @retval None
+  * @retval The RTC instance
   */
-void STM32LowPower::programRtcWakeUp(uint32_t ms, LP_Mode lp_mode)
+STM32RTC &STM32LowPower::configRtcForLowPower(LP_Mode lp_mode)
 {
-  uint32_t epoc;
-  uint32_t sec;
   STM32RTC &rtc = STM32RTC::getInstance();
   STM32RTC::Source_Clock clkSrc = rtc.getClockSource();
 
@@ -201,6 +260,33 @@ void STM32LowPower::programRtcWakeUp(uint32_t ms, LP_Mode lp_mode)
       break;
   }
   rtc.configForLowPower(clkSrc);
+  return rtc;
+}
+
+/**
+  * @brief  Configure the RTC alarm to wake up at a time of day. No calendar
+  *         conversion is done, so the wakeup can be computed from the last one
+  *         (next = previous + period) and does not drift.
+  * @param  dayMs: milliseconds since midnight of the RTC time
+  * @param  lp_mode: low power mode targeted.
+  * @retval None
+  */
+void STM32LowPower::programRtcWakeUpAt(uint32_t dayMs, LP_Mode lp_mode)
+{
+  configRtcForLowPower(lp_mode).setAlarmDayMs(dayMs);
+}
+
+/**
+  * @brief  Configure the RTC alarm
+  * @param  ms: time of the alarm in milliseconds.
+  * @param  lp_mode: low power mode targeted.
+  * @retval None
+  */
+void STM32LowPower::programRtcWakeUp(uint32_t ms, LP_Mode lp_mode)
+{
+  uint32_t epoc;
+  uint32_t sec;
+  STM32RTC &rtc = configRtcForLowPower(lp_mode);
 
   if (ms != 0) {
     // Convert millisecond to second
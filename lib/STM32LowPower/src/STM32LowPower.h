@@ -89,6 +89,14 @@ class STM32LowPower {
       shutdown((uint32_t)ms);
     }
 
+    void deepSleepUntil(uint32_t dayMs);
+    void shutdownUntil(uint32_t dayMs);
+#if defined(RTC_WAKEUP_TIMER)
+    void deepSleepPeriodic(uint32_t ms);
+#endif
+
+    uint32_t wakeupLatency(void);
+
     void attachInterruptWakeup(uint32_t pin, voidFuncPtrVoid callback, uint32_t mode, LP_Mode LowPowerMode = SHUTDOWN_MODE);
 
     void enableWakeupFrom(HardwareSerial *serial, voidFuncPtrVoid callback);
@@ -98,7 +106,10 @@ class STM32LowPower {
     bool _configured;     // Low Power mode initialization status
     serial_t *_serial;    // Serial for wakeup from deep sleep
     bool _rtc_wakeup;     // Is RTC wakeup?
+    uint32_t _wakeup_period; // Period of the RTC wakeup timer, 0 when off
+    STM32RTC &configRtcForLowPower(LP_Mode lp_mode);
     void programRtcWakeUp(uint32_t ms, LP_Mode lp_mode);
+    void programRtcWakeUpAt(uint32_t dayMs, LP_Mode lp_mode);
 };
 
 extern STM32LowPower LowPower;
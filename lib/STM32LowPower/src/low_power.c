@@ -40,6 +40,8 @@ static UART_HandleTypeDef *WakeUpUart = NULL;
 #endif
 /* Save callback pointer */
 static void (*WakeUpUartCb)(void) = NULL;
+/* Time from leaving the last stop mode until the clocks were back, in us */
+static uint32_t WakeUpLatency = 0;
 
 #if defined(PWR_FLAG_WUF)
 #define PWR_FLAG_WU PWR_FLAG_WUF
@@ -50,6 +52,22 @@ static void (*WakeUpUartCb)(void) = NULL;
 #define PWR_FLAG_SB PWR_FLAG_SBF
 #endif
 
+/**
+  * @brief  Microseconds since boot, read with interrupts masked. A SysTick
+  *         that is pending is counted first, like its handler would, so
+  *         the time does not go back when SysTick wrapped since masking.
+  * @param  None
+  * @retval Microseconds
+  */
+static uint32_t maskedMicros(void)
+{
+  if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+    SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+    HAL_IncTick();
+  }
+  return getCurrentMicros();
+}
+
 /**
   * @brief  Initialize low power mode
   * @param  None
@@ -302,6 +320,10 @@ void LowPower_stop(serial_t *obj)
   {
     HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
   }
+  /* SysTick resumes where it stopped, it counts the wakeup path from here.
+     Interrupts stay masked until the end, so a SysTick that wraps in
+     between is counted by maskedMicros(). */
+  uint32_t woken = maskedMicros();
 
   /* Exit Stop mode reset clocks */
   SystemClock_ConfigFromStop();
@@ -310,14 +332,17 @@ void LowPower_stop(serial_t *obj)
     /* In case of WakeUp from UART, reset its clock source to HSI */
     uart_config_lowpower(obj);
     HAL_UARTEx_DisableStopMode(WakeUpUart);
+    /* Its kernel clock has to run before it can receive again */
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_HSIRDY) == RESET);
   }
 #else
   UNUSED(obj);
 #endif
+  /* No fixed delay: the clock configuration waits for the ready flags of
+     the oscillators it starts */
+  WakeUpLatency = maskedMicros() - woken;
   __enable_irq();
 
-  HAL_Delay(10);
-
   if (WakeUpUartCb != NULL) {
     WakeUpUartCb();
   }
@@ -407,6 +432,17 @@ void LowPower_EnableWakeUpUart(serial_t *serial, void (*FuncPtr)(void))
   WakeUpUartCb = FuncPtr;
 }
 
+/**
+  * @brief  Time the last wakeup from stop mode took, from the WFI returning
+  *         until the clocks were configured again
+  * @param  None
+  * @retval Latency in microseconds
+  */
+uint32_t LowPower_wakeupLatency(void)
+{
+  return WakeUpLatency;
+}
+
 /**
   * @brief  Configures system clock and system IP clocks after wake-up from STOP
   * @note   Weaked function which can be redefined by user at the sketch level.
@@ -60,6 +60,7 @@ void LowPower_sleep(uint32_t regulator);
 void LowPower_stop(serial_t *obj);
 void LowPower_standby();
 void LowPower_shutdown();
+uint32_t LowPower_wakeupLatency(void);
 /* Weaked function */
 void SystemClock_ConfigFromStop(void);
 #ifdef __cplusplus
@@ -39,6 +39,7 @@
 #include "STM32RTC.h"
 
 #define EPOCH_TIME_OFF      946684800  // This is 1st January 2000, 00:00:00 in epoch time
+#define DAY_MS              86400000UL // Milliseconds in a day
 #define EPOCH_TIME_YEAR_OFF 100        // years since 1900
 
 // Initialize static variable
@@ -201,6 +202,32 @@ void STM32RTC::disableAlarm(void)
   }
 }
 
+#if defined(RTC_WAKEUP_TIMER)
+/**
+  * @brief enable the periodic wakeup timer. It raises the RTC interrupt
+  *        every period from now on, independent of the alarm.
+  * @param ms: period in milliseconds
+  * @retval None
+  */
+void STM32RTC::enableWakeUpTimer(uint32_t ms)
+{
+  if (_configured) {
+    RTC_StartWakeUpTimer(ms);
+  }
+}
+
+/**
+  * @brief disable the periodic wakeup timer.
+  * @retval None
+  */
+void STM32RTC::disableWakeUpTimer(void)
+{
+  if (_configured) {
+    RTC_StopWakeUpTimer();
+  }
+}
+#endif
+
 /**
   * @brief attach a callback to the RTC alarm interrupt.
   * @param callback: pointer to the callback
@@ -908,6 +935,56 @@ void STM32RTC::setY2kEpoch(uint32_t ts)
   }
 }
 
+/**
+  * @brief  get the time of day, straight from the time register without
+  *         a calendar conversion
+  * @retval milliseconds since midnight
+  */
+uint32_t STM32RTC::getDayMs(void)
+{
+  uint8_t hours = 0, minutes = 0, seconds = 0;
+  uint32_t subSeconds = 0;
+  hourAM_PM_t period = HOUR_AM;
+  uint8_t unused;
+
+  if (_configured) {
+    RTC_GetTime(&hours, &minutes, &seconds, &subSeconds, &period);
+    // reading the date unlocks the shadow registers for the next read
+    RTC_GetDate(&unused, &unused, &unused, &unused);
+    if (_format == HOUR_12) {
+      hours = (hours % 12) + ((period == HOUR_PM) ? 12 : 0);
+    }
+  }
+  return (((uint32_t)hours * 60 + minutes) * 60 + seconds) * 1000 + subSeconds;
+}
+
+/**
+  * @brief  set the RTC alarm to a time of day, matching hours, minutes,
+  *         seconds and subseconds, without a calendar conversion
+  * @param  ms: milliseconds since midnight, taken modulo one day
+  */
+void STM32RTC::setAlarmDayMs(uint32_t ms)
+{
+  if (_configured) {
+    uint32_t sec = (ms % DAY_MS) / 1000;
+    uint8_t hours = sec / 3600;
+
+    _alarmSubSeconds = ms % 1000;
+    _alarmSeconds = sec % 60;
+    _alarmMinutes = (sec / 60) % 60;
+    _alarmPeriod = AM;
+    if (_format == HOUR_12) {
+      _alarmPeriod = (hours < 12) ? AM : PM;
+      hours %= 12;
+      if (hours == 0) {
+        hours = 12;
+      }
+    }
+    _alarmHours = hours;
+    enableAlarm(MATCH_HHMMSS);
+  }
+}
+
 /**
   * @brief  configure RTC source clock for low power
   * @param  none
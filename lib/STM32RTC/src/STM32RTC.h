@@ -122,6 +122,11 @@ class STM32RTC {
     void enableAlarm(Alarm_Match match);
     void disableAlarm(void);
 
+#if defined(RTC_WAKEUP_TIMER)
+    void enableWakeUpTimer(uint32_t ms);
+    void disableWakeUpTimer(void);
+#endif
+
     void attachInterrupt(voidFuncPtr callback, void *data = nullptr);
     void detachInterrupt(void);
 
@@ -189,6 +194,11 @@ class STM32RTC {
     void setY2kEpoch(uint32_t ts);
     void setAlarmEpoch(uint32_t ts, Alarm_Match match = MATCH_DHHMMSS, uint32_t subSeconds = 0);
 
+    /* Time of day Functions */
+
+    uint32_t getDayMs(void);
+    void setAlarmDayMs(uint32_t ms);
+
     void getPrediv(int8_t *predivA, int16_t *predivS);
     void setPrediv(int8_t predivA, int16_t predivS);
 
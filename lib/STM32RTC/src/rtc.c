@@ -664,6 +664,47 @@ void RTC_GetAlarm(uint8_t *day, uint8_t *hours, uint8_t *minutes, uint8_t *secon
   }
 }
 
+#if defined(RTC_WAKEUP_TIMER)
+/**
+  * @brief Start the wakeup timer with IT mode. It reloads itself and raises
+  *        the interrupt every period until it is stopped, Alarm A is not used.
+  * @param ms: period in milliseconds. Up to about 32 s it counts RTCCLK/16
+  *            (0.5 ms with LSE), longer periods are counted in seconds (up
+  *            to 65536 s).
+  * @retval None
+  */
+void RTC_StartWakeUpTimer(uint32_t ms)
+{
+  uint32_t clock = RTC_WAKEUPCLOCK_RTCCLK_DIV16;
+  uint32_t counter;
+
+  if ((predivAsync == -1) || (predivSync == -1)) {
+    RTC_computePrediv(&predivAsync, &predivSync);
+  }
+  /* The prescalers divide RTCCLK down to 1 Hz */
+  counter = (uint32_t)(((uint64_t)ms * (predivAsync + 1) * (predivSync + 1)) / 16000);
+  if (counter > 0x10000) {
+    clock = RTC_WAKEUPCLOCK_CK_SPRE_16BITS;
+    counter = (ms / 1000 < 0x10000) ? ms / 1000 : 0x10000;
+  }
+  if (counter == 0) {
+    counter = 1;
+  }
+  /* The period is WUT + 1 ticks */
+  HAL_RTCEx_SetWakeUpTimer_IT(&RtcHandle, counter - 1, clock);
+}
+
+/**
+  * @brief Stop the wakeup timer
+  * @param None
+  * @retval None
+  */
+void RTC_StopWakeUpTimer(void)
+{
+  HAL_RTCEx_DeactivateWakeUpTimer(&RtcHandle);
+}
+#endif /* RTC_WAKEUP_TIMER */
+
 /**
   * @brief Attach alarm callback.
   * @param func: pointer to the callback
@@ -708,6 +749,9 @@ void HAL_RTC_AlarmAEventCallback(RTC_HandleTypeDef *hrtc)
 void RTC_Alarm_IRQHandler(void)
 {
   HAL_RTC_AlarmIRQHandler(&RtcHandle);
+#if defined(RTC_WAKEUP_TIMER)
+  HAL_RTCEx_WakeUpTimerIRQHandler(&RtcHandle);
+#endif
 }
 
 #ifdef __cplusplus
@@ -40,6 +40,9 @@
 //  - Tabs were converted to 2 spaces
 //  - An #include and #if guard was added
 //  - S_Table is now stored in PROGMEM
+// It was extended with lmic_aes_expandKey and lmic_aes_encryptSched,
+// which split the round key calculation from the encryption so a key
+// schedule can be calculated once and reused for every block.
 
 #include "../../lmic/oslmic.h"
 
@@ -73,7 +76,10 @@ static CONST_TABLE(unsigned char, S_Table)[16][16] = {
 };
 
 extern "C" void lmic_aes_encrypt(unsigned char *Data, unsigned char *Key);
-static void AES_Add_Round_Key(unsigned char *Round_Key);
+extern "C" void lmic_aes_expandKey(const unsigned char *Key, unsigned char *Schedule);
+extern "C" void lmic_aes_encryptSched(unsigned char *Data, const unsigned char *Schedule);
+static void AES_Round(unsigned char Last);
+static void AES_Add_Round_Key(const unsigned char *Round_Key);
 static unsigned char AES_Sub_Byte(unsigned char Byte);
 static void AES_Shift_Rows();
 static void AES_Mix_Collums();
@@ -168,6 +174,110 @@ void lmic_aes_encrypt(unsigned char *Data, unsigned char *Key)
 
 }
 
+/*
+*****************************************************************************************
+* Description : Function that calculates all 11 round keys for a key at once
+*
+* Arguments   : *Key        Key to expand is a 16 byte long arry
+*               *Schedule   176 byte long array that receives the round keys, the
+*                           first 16 bytes are the key itself
+*****************************************************************************************
+*/
+void lmic_aes_expandKey(const unsigned char *Key, unsigned char *Schedule)
+{
+  unsigned char i;
+  unsigned char Round;
+
+  for(i = 0; i < 16; i++)
+  {
+    Schedule[i] = Key[i];
+  }
+
+  for(Round = 1; Round < 11; Round++)
+  {
+    for(i = 0; i < 16; i++)
+    {
+      Schedule[i + 16] = Schedule[i];
+    }
+    Schedule += 16;
+    AES_Calculate_Round_Key(Round,Schedule);
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function for encrypting data using a key schedule calculated by
+*               lmic_aes_expandKey
+*
+* Arguments   : *Data       Data to encrypt is a 16 byte long arry
+*               *Schedule   176 byte long array holding the round keys
+*****************************************************************************************
+*/
+void lmic_aes_encryptSched(unsigned char *Data, const unsigned char *Schedule)
+{
+  unsigned char Row,Collum;
+  unsigned char Round;
+
+  //Copy input to State arry
+  for(Collum = 0; Collum < 4; Collum++)
+  {
+    for(Row = 0; Row < 4; Row++)
+    {
+      State[Row][Collum] = Data[Row + (4*Collum)];
+    }
+  }
+
+  //Add round key
+  AES_Add_Round_Key(Schedule);
+
+  //Preform 9 full rounds and the last one whitout mix collums
+  for(Round = 1; Round < 11; Round++)
+  {
+    AES_Round(Round == 10);
+    AES_Add_Round_Key(Schedule + (16*Round));
+  }
+
+  //Copy the State into the data array
+  for(Collum = 0; Collum < 4; Collum++)
+  {
+    for(Row = 0; Row < 4; Row++)
+    {
+      Data[Row + (4*Collum)] = State[Row][Collum];
+    }
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function that preforms one round on the State, without adding the
+*               round key
+*
+* Arguments   : Last    Non-zero for the last round, which skips mix collums
+*****************************************************************************************
+*/
+static void AES_Round(unsigned char Last)
+{
+  unsigned char Row,Collum;
+
+  //Preform Byte substitution with S table
+  for(Collum = 0; Collum < 4; Collum++)
+  {
+    for(Row = 0; Row < 4; Row++)
+    {
+      State[Row][Collum] = AES_Sub_Byte(State[Row][Collum]);
+    }
+  }
+
+  //Preform Row Shift
+  AES_Shift_Rows();
+
+  //Mix Collums
+  if(!Last)
+  {
+    AES_Mix_Collums();
+  }
+}
+
 /*
 *****************************************************************************************
 * Description : Function that add's the round key for the current round
@@ -175,7 +285,7 @@ void lmic_aes_encrypt(unsigned char *Data, unsigned char *Key)
 * Arguments   : *Round_Key    16 byte long array holding the Round Key
 *****************************************************************************************
 */
-static void AES_Add_Round_Key(unsigned char *Round_Key)
+static void AES_Add_Round_Key(const unsigned char *Round_Key)
 {
   unsigned char Row,Collum;
 
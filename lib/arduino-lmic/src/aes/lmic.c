@@ -10,6 +10,9 @@
  *******************************************************************************/
 
 #include "../lmic/oslmic.h"
+#if defined(LMIC_MULTI_INSTANCE)
+#include "../lmic/lmic.h" // AESKEY and AESAUX are in lmic_ctx_t
+#endif
 
 #if defined(USE_ORIGINAL_AES)
 
@@ -202,8 +205,10 @@ static CONST_TABLE(u4_t, AES_E4)[256] = {
                                    a ^=  (u4_t)TABLE_GET_U1(AES_S, u1(r3)    )
 
 // global area for passing parameters (aux, key) and for storing round keys
+#if !defined(LMIC_MULTI_INSTANCE)
 u4_t AESAUX[16/sizeof(u4_t)];
-u4_t AESKEY[11*16/sizeof(u4_t)];
+u4_t AESKEY[AESKEY_SIZE/sizeof(u4_t)];
+#endif
 
 // generate 1+10 roundkeys for encryption with 128-bit key
 // read 128-bit key from AESKEY in MSBF, generate roundkey words in place
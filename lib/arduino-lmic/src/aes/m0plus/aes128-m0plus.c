@@ -0,0 +1,159 @@
+/*******************************************************************************
+ * LICENSE
+ *
+ * Permission is hereby granted, free of charge, to anyone
+ * obtaining a copy of this document and accompanying files,
+ * to do whatever they want with them without any restriction,
+ * including, but not limited to, copying, modification and
+ * redistribution.
+ *
+ * NO WARRANTY OF ANY KIND IS PROVIDED.
+ *******************************************************************************/
+
+/*
+ * AES-128 encryption for 32-bit cores without big lookup tables, such as
+ * the Cortex-M0+. Each column of the state is kept in a 32-bit word (row
+ * 0 in the lowest byte), so ShiftRows is folded into the S-box lookups
+ * and MixColumns is done on a whole column at once with word rotates and
+ * a packed xtime. The only table is the 256 byte S-box.
+ *
+ * This offers the same functions as the Ideetron implementation, for use
+ * by aes/other.c:
+ *
+ *      void lmic_aes_encrypt(u1_t *data, u1_t *key);
+ *      void lmic_aes_expandKey(const u1_t *key, u1_t *sched);
+ *      void lmic_aes_encryptSched(u1_t *data, const u1_t *sched);
+ *
+ * The key schedule must be 4-byte aligned.
+ */
+
+#include "../../lmic/oslmic.h"
+
+#if defined(USE_M0PLUS_AES)
+
+static CONST_TABLE(u1_t, AES_SBOX)[256] = {
+    0x63,0x7C,0x77,0x7B,0xF2,0x6B,0x6F,0xC5,0x30,0x01,0x67,0x2B,0xFE,0xD7,0xAB,0x76,
+    0xCA,0x82,0xC9,0x7D,0xFA,0x59,0x47,0xF0,0xAD,0xD4,0xA2,0xAF,0x9C,0xA4,0x72,0xC0,
+    0xB7,0xFD,0x93,0x26,0x36,0x3F,0xF7,0xCC,0x34,0xA5,0xE5,0xF1,0x71,0xD8,0x31,0x15,
+    0x04,0xC7,0x23,0xC3,0x18,0x96,0x05,0x9A,0x07,0x12,0x80,0xE2,0xEB,0x27,0xB2,0x75,
+    0x09,0x83,0x2C,0x1A,0x1B,0x6E,0x5A,0xA0,0x52,0x3B,0xD6,0xB3,0x29,0xE3,0x2F,0x84,
+    0x53,0xD1,0x00,0xED,0x20,0xFC,0xB1,0x5B,0x6A,0xCB,0xBE,0x39,0x4A,0x4C,0x58,0xCF,
+    0xD0,0xEF,0xAA,0xFB,0x43,0x4D,0x33,0x85,0x45,0xF9,0x02,0x7F,0x50,0x3C,0x9F,0xA8,
+    0x51,0xA3,0x40,0x8F,0x92,0x9D,0x38,0xF5,0xBC,0xB6,0xDA,0x21,0x10,0xFF,0xF3,0xD2,
+    0xCD,0x0C,0x13,0xEC,0x5F,0x97,0x44,0x17,0xC4,0xA7,0x7E,0x3D,0x64,0x5D,0x19,0x73,
+    0x60,0x81,0x4F,0xDC,0x22,0x2A,0x90,0x88,0x46,0xEE,0xB8,0x14,0xDE,0x5E,0x0B,0xDB,
+    0xE0,0x32,0x3A,0x0A,0x49,0x06,0x24,0x5C,0xC2,0xD3,0xAC,0x62,0x91,0x95,0xE4,0x79,
+    0xE7,0xC8,0x37,0x6D,0x8D,0xD5,0x4E,0xA9,0x6C,0x56,0xF4,0xEA,0x65,0x7A,0xAE,0x08,
+    0xBA,0x78,0x25,0x2E,0x1C,0xA6,0xB4,0xC6,0xE8,0xDD,0x74,0x1F,0x4B,0xBD,0x8B,0x8A,
+    0x70,0x3E,0xB5,0x66,0x48,0x03,0xF6,0x0E,0x61,0x35,0x57,0xB9,0x86,0xC1,0x1D,0x9E,
+    0xE1,0xF8,0x98,0x11,0x69,0xD9,0x8E,0x94,0x9B,0x1E,0x87,0xE9,0xCE,0x55,0x28,0xDF,
+    0x8C,0xA1,0x89,0x0D,0xBF,0xE6,0x42,0x68,0x41,0x99,0x2D,0x0F,0xB0,0x54,0xBB,0x16,
+};
+
+#define SB(x) ((u4_t)TABLE_GET_U1(AES_SBOX, (x)))
+
+// Rotate right by n bits, a single ROR instruction on ARM
+#define ROR(w,n) (((w) >> (n)) | ((w) << (32-(n))))
+
+// Multiply all four bytes of w by x in GF(2^8)
+#define XTIME(w) ((((w) & 0x7F7F7F7F) << 1) ^ ((((w) >> 7) & 0x01010101) * 0x1B))
+
+// Words are loaded byte by byte, the buffers need not be aligned
+static u4_t rlsbf4 (const u1_t* buf) {
+    return (u4_t)buf[0] | ((u4_t)buf[1]<<8) | ((u4_t)buf[2]<<16) | ((u4_t)buf[3]<<24);
+}
+
+static void wlsbf4 (u1_t* buf, u4_t v) {
+    buf[0] = v;
+    buf[1] = v>>8;
+    buf[2] = v>>16;
+    buf[3] = v>>24;
+}
+
+// SubWord(RotWord(w)) of the key expansion
+static u4_t subRotWord (u4_t w) {
+    return SB((w>>8)&0xFF) | (SB((w>>16)&0xFF)<<8) | (SB(w>>24)<<16) | (SB(w&0xFF)<<24);
+}
+
+// Turn the round key in k[0..3] into the next one
+static void nextRoundKey (u4_t* k, u1_t* rcon) {
+    k[0] ^= subRotWord(k[3]) ^ *rcon;
+    k[1] ^= k[0];
+    k[2] ^= k[1];
+    k[3] ^= k[2];
+    *rcon = (*rcon << 1) ^ ((*rcon & 0x80) ? 0x1B : 0);
+}
+
+// SubBytes and ShiftRows on the state s, result in t. Row r of column c
+// comes from column c+r.
+static void subShift (u4_t* t, const u4_t* s) {
+    for( u1_t c=0; c<4; c++ ) {
+        t[c] = SB(s[c] & 0xFF)
+            | (SB((s[(c+1)&3] >>  8) & 0xFF) <<  8)
+            | (SB((s[(c+2)&3] >> 16) & 0xFF) << 16)
+            | (SB( s[(c+3)&3] >> 24        ) << 24);
+    }
+}
+
+// MixColumns on a single column:
+// out[r] = 2*a[r] ^ 3*a[r+1] ^ a[r+2] ^ a[r+3]
+//        = xtime(a[r]^a[r+1]) ^ a[r+1] ^ (a[r+2]^a[r+3])
+static u4_t mixColumn (u4_t w) {
+    u4_t t = w ^ ROR(w,8);
+    return XTIME(t) ^ ROR(w,8) ^ ROR(t,16);
+}
+
+// Run the rounds on s, with round keys either taken from sched (11*4
+// words) or, if sched is NULL, derived on the fly from the key in k.
+static void encryptState (u4_t* s, const u4_t* sched, u4_t* k) {
+    u4_t t[4];
+    u1_t rcon = 1;
+
+    for( u1_t round=1; round<=10; round++ ) {
+        subShift(t, s);
+        if( sched ) {
+            k = (u4_t*)sched + 4*round;
+        } else {
+            nextRoundKey(k, &rcon);
+        }
+        for( u1_t c=0; c<4; c++ )
+            s[c] = (round < 10 ? mixColumn(t[c]) : t[c]) ^ k[c];
+    }
+}
+
+void lmic_aes_encrypt (u1_t* data, u1_t* key) {
+    u4_t s[4], k[4];
+    for( u1_t c=0; c<4; c++ ) {
+        k[c] = rlsbf4(key+4*c);
+        s[c] = rlsbf4(data+4*c) ^ k[c];
+    }
+    encryptState(s, NULL, k);
+    for( u1_t c=0; c<4; c++ )
+        wlsbf4(data+4*c, s[c]);
+}
+
+void lmic_aes_expandKey (const u1_t* key, u1_t* sched) {
+    u4_t* w = (u4_t*)sched;
+    u4_t k[4];
+    u1_t rcon = 1;
+
+    for( u1_t c=0; c<4; c++ )
+        w[c] = k[c] = rlsbf4(key+4*c);
+    for( u1_t round=1; round<=10; round++ ) {
+        nextRoundKey(k, &rcon);
+        for( u1_t c=0; c<4; c++ )
+            w[4*round+c] = k[c];
+    }
+}
+
+void lmic_aes_encryptSched (u1_t* data, const u1_t* sched) {
+    const u4_t* w = (const u4_t*)sched;
+    u4_t s[4];
+    for( u1_t c=0; c<4; c++ )
+        s[c] = rlsbf4(data+4*c) ^ w[c];
+    encryptState(s, w, NULL);
+    for( u1_t c=0; c<4; c++ )
+        wlsbf4(data+4*c, s[c]);
+}
+
+#endif // defined(USE_M0PLUS_AES)
@@ -28,15 +28,75 @@
  */
 
 #include "../lmic/oslmic.h"
+#if defined(LMIC_MULTI_INSTANCE)
+#include "../lmic/lmic.h" // AESKEY and AESAUX are in lmic_ctx_t
+#endif
 
 #if !defined(USE_ORIGINAL_AES)
 
 // This should be defined elsewhere
 void lmic_aes_encrypt(u1_t *data, u1_t *key);
+#if (defined(USE_IDEETRON_AES) || defined(USE_M0PLUS_AES)) && defined(AES_KEY_SCHEDULE)
+void lmic_aes_expandKey(const u1_t *key, u1_t *sched);
+void lmic_aes_encryptSched(u1_t *data, const u1_t *sched);
+#define AES_SCHED_SIZE (11*16)
+#endif
 
 // global area for passing parameters (aux, key)
+#if !defined(LMIC_MULTI_INSTANCE)
 u4_t AESAUX[16/sizeof(u4_t)];
-u4_t AESKEY[16/sizeof(u4_t)];
+u4_t AESKEY[AESKEY_SIZE/sizeof(u4_t)];
+#endif
+
+#if defined(AES_SCHED_SIZE)
+// Expanded key schedules of the last two keys used. LMIC alternates
+// between the network and application session keys for every frame, so
+// two entries let both keep their schedule for the whole session. The
+// first 16 bytes of a schedule are the key itself (the Cortex-M0+ one
+// stores words, so only on little endian cores), which is what the
+// lookup compares against. Word aligned, as the Cortex-M0+ implementation
+// stores the schedule as words. With LMIC_MULTI_INSTANCE all stacks share
+// the entries, which only costs speed as they are found by the key.
+static u4_t aes_sched[2][AES_SCHED_SIZE/sizeof(u4_t)];
+static u1_t aes_sched_valid; // bitmap of filled entries
+static u1_t aes_sched_last;  // entry used most recently
+
+// Return the schedule for the given key, expanding it into the least
+// recently used entry when it is not cached yet
+static const u1_t* aes_select(xref2cu1_t key) {
+    for (u1_t i = 0; i < 2; i++) {
+        if ((aes_sched_valid & (1 << i)) && memcmp(aes_sched[i], key, 16) == 0) {
+            aes_sched_last = i;
+            return (const u1_t*)aes_sched[i];
+        }
+    }
+    aes_sched_last ^= 1;
+    lmic_aes_expandKey(key, (u1_t*)aes_sched[aes_sched_last]);
+    aes_sched_valid |= 1 << aes_sched_last;
+    return (const u1_t*)aes_sched[aes_sched_last];
+}
+
+// Encrypt a single block with a key returned by aes_select()
+static void aes_encryptWith(const u1_t* k, xref2u1_t buf) {
+    lmic_aes_encryptSched(buf, k);
+}
+#else
+static const u1_t* aes_select(xref2cu1_t key) {
+    return key;
+}
+
+static void aes_encryptWith(const u1_t* k, xref2u1_t buf) {
+    lmic_aes_encrypt(buf, (u1_t*)k);
+}
+#endif
+
+// Key for AESKEY, set by os_aes()
+static const u1_t* aes_cur;
+
+// Encrypt a single block with the key in AESKEY
+static void aes_encrypt(xref2u1_t buf) {
+    aes_encryptWith(aes_cur, buf);
+}
 
 // Shift the given buffer left one bit
 static void shift_left(xref2u1_t buf, u1_t len) {
@@ -50,12 +110,60 @@ static void shift_left(xref2u1_t buf, u1_t len) {
     }
 }
 
+// CMAC subkeys K1 and K2 and the key they were derived from. LMIC only
+// MICs with the network session key (or the device key while joining),
+// so a single entry covers every frame of a session and the extra AES
+// block to derive them is only spent when a new key is installed (or,
+// with LMIC_MULTI_INSTANCE, another stack runs in between).
+static u1_t cmac_key[16];
+static u1_t cmac_k1[16];
+static u1_t cmac_k2[16];
+static u1_t cmac_valid;
+
+// Multiply the given subkey by x in GF(2^128) (RFC4493 section 2.3)
+static void cmac_double(xref2u1_t dst, xref2cu1_t src) {
+    u1_t msb = src[0] & 0x80;
+    memcpy(dst, src, 16);
+    shift_left(dst, 16);
+    if (msb)
+        dst[15] ^= 0x87;
+}
+
+// Make sure cmac_k1/cmac_k2 belong to the key in AESKEY
+static void cmac_subkeys() {
+    if (cmac_valid && memcmp(cmac_key, AESkey, 16) == 0)
+        return;
+
+    // K1 and K2 are calculated by encrypting the all-zeroes block
+    // and then applying some shifts and xor on that.
+    u1_t l[16];
+    memset(l, 0, sizeof(l));
+    aes_encrypt(l);
+    cmac_double(cmac_k1, l);
+    cmac_double(cmac_k2, cmac_k1);
+
+    memcpy(cmac_key, AESkey, 16);
+    cmac_valid = 1;
+}
+
 // Apply RFC4493 CMAC, using AESKEY as the key. If prepend_aux is true,
 // AESAUX is prepended to the message. AESAUX is used as working memory
 // in any case. The CMAC result is returned in AESAUX as well.
-static void os_aes_cmac(xref2u1_t buf, u2_t len, u1_t prepend_aux) {
+//
+// If ctrk is not NULL, the message is encrypted with AES-CTR in the same
+// pass, starting ctroff bytes into buf, using key ctrk (as returned by
+// aes_select()) and ctr as the counter block (see os_aes_ctr). Every
+// byte is encrypted right before it is fed into the CMAC, so the MIC
+// covers the encrypted message.
+static void os_aes_cmac(xref2u1_t buf, u2_t len, u1_t prepend_aux,
+                        const u1_t* ctrk, xref2u1_t ctr, u2_t ctroff) {
+    u1_t ks[16];
+    u1_t ksi = 0;
+
+    cmac_subkeys();
+
     if (prepend_aux)
-        lmic_aes_encrypt(AESaux, AESkey);
+        aes_encrypt(AESaux);
     else
         memset (AESaux, 0, 16);
 
@@ -70,37 +178,29 @@ static void os_aes_cmac(xref2u1_t buf, u2_t len, u1_t prepend_aux) {
                 need_padding = 1;
                 break;
             }
+            if (ctroff) {
+                ctroff--;
+            } else if (ctrk) {
+                if (ksi == 0) {
+                    memcpy(ks, ctr, sizeof(ks));
+                    aes_encryptWith(ctrk, ks);
+                    ctr[15]++;
+                }
+                *buf ^= ks[ksi];
+                ksi = (ksi + 1) & 15;
+            }
             AESaux[i] ^= *buf;
         }
 
         if (len == 0) {
-            // Final block, xor with K1 or K2. K1 and K2 are calculated
-            // by encrypting the all-zeroes block and then applying some
-            // shifts and xor on that.
-            u1_t final_key[16];
-            memset(final_key, 0, sizeof(final_key));
-            lmic_aes_encrypt(final_key, AESkey);
-
-            // Calculate K1
-            u1_t msb = final_key[0] & 0x80;
-            shift_left(final_key, sizeof(final_key));
-            if (msb)
-                final_key[sizeof(final_key)-1] ^= 0x87;
-
-            // If the final block was not complete, calculate K2 from K1
-            if (need_padding) {
-                msb = final_key[0] & 0x80;
-                shift_left(final_key, sizeof(final_key));
-                if (msb)
-                    final_key[sizeof(final_key)-1] ^= 0x87;
-            }
-
-            // Xor with K1 or K2
-            for (u1_t i = 0; i < sizeof(final_key); ++i)
+            // Final block, xor with K1, or K2 if the final block was
+            // not complete.
+            xref2u1_t final_key = need_padding ? cmac_k2 : cmac_k1;
+            for (u1_t i = 0; i < 16; ++i)
                 AESaux[i] ^= final_key[i];
         }
 
-        lmic_aes_encrypt(AESaux, AESkey);
+        aes_encrypt(AESaux);
     }
 }
 
@@ -112,7 +212,7 @@ static void os_aes_ctr (xref2u1_t buf, u2_t len) {
     while (len) {
         // Encrypt the counter block with the selected key
         memcpy(ctr, AESaux, sizeof(ctr));
-        lmic_aes_encrypt(ctr, AESkey);
+        aes_encrypt(ctr);
 
         // Xor the payload with the resulting ciphertext
         for (u1_t i = 0; i < 16 && len > 0; i++, len--, buf++)
@@ -124,15 +224,16 @@ static void os_aes_ctr (xref2u1_t buf, u2_t len) {
 }
 
 u4_t os_aes (u1_t mode, xref2u1_t buf, u2_t len) {
+    aes_cur = aes_select(AESkey);
     switch (mode & ~AES_MICNOAUX) {
         case AES_MIC:
-            os_aes_cmac(buf, len, /* prepend_aux */ !(mode & AES_MICNOAUX));
+            os_aes_cmac(buf, len, /* prepend_aux */ !(mode & AES_MICNOAUX), NULL, NULL, 0);
             return os_rmsbf4(AESaux);
 
         case AES_ENC:
             // TODO: Check / handle when len is not a multiple of 16
             for (u1_t i = 0; i < len; i += 16)
-                lmic_aes_encrypt(buf+i, AESkey);
+                aes_encrypt(buf+i);
             break;
 
         case AES_CTR:
@@ -142,4 +243,13 @@ u4_t os_aes (u1_t mode, xref2u1_t buf, u2_t len) {
     return 0;
 }
 
+u4_t os_aes_ctrmic (xref2cu1_t ctrkey, xref2u1_t ctr, xref2u1_t buf, u2_t off, u2_t len) {
+    // Both keys are looked up once, the CTR key first so the MIC key
+    // ends up as the most recently used one.
+    const u1_t* ctrk = aes_select(ctrkey);
+    aes_cur = aes_select(AESkey);
+    os_aes_cmac(buf, len, /* prepend_aux */ 1, ctrk, ctr, off);
+    return os_rmsbf4(AESaux);
+}
+
 #endif // !defined(USE_ORIGINAL_AES)
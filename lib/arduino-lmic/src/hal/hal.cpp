@@ -17,6 +17,14 @@
 // -----------------------------------------------------------------------------
 // I/O
 
+#if defined(ARDUINO_ARCH_STM32)
+// The DIO lines are still polled by hal_io_check(). Their interrupt only
+// wakes the core from hal_sleep(), so a radio event is handled right away
+// instead of with the next SysTick.
+static void hal_dio_wake () {
+}
+#endif
+
 static void hal_io_init () {
     // NSS and DIO0 are required, DIO1 is required for LoRa, DIO2 for FSK
     ASSERT(lmic_pins.nss != LMIC_UNUSED_PIN);
@@ -26,14 +34,23 @@ static void hal_io_init () {
     pinMode(lmic_pins.nss, OUTPUT);
     if (lmic_pins.rxtx != LMIC_UNUSED_PIN)
         pinMode(lmic_pins.rxtx, OUTPUT);
+    // RST stays floating until radio_init() resets the radio, driving it
+    // here would reset a radio that kept its state (radio_initWarm)
     if (lmic_pins.rst != LMIC_UNUSED_PIN)
-        pinMode(lmic_pins.rst, OUTPUT);
+        pinMode(lmic_pins.rst, INPUT);
 
     pinMode(lmic_pins.dio[0], INPUT);
     if (lmic_pins.dio[1] != LMIC_UNUSED_PIN)
         pinMode(lmic_pins.dio[1], INPUT);
     if (lmic_pins.dio[2] != LMIC_UNUSED_PIN)
         pinMode(lmic_pins.dio[2], INPUT);
+
+#if defined(ARDUINO_ARCH_STM32)
+    for (uint8_t i = 0; i < NUM_DIO; ++i) {
+        if (lmic_pins.dio[i] != LMIC_UNUSED_PIN)
+            attachInterrupt(digitalPinToInterrupt(lmic_pins.dio[i]), hal_dio_wake, RISING);
+    }
+#endif
 }
 
 // val == 1  => tx 1
@@ -55,7 +72,12 @@ void hal_pin_rst (u1_t val) {
     }
 }
 
+#if defined(LMIC_MULTI_INSTANCE)
+// every stack has a radio of its own
+#define dio_states (LMIC_CTX->dio)
+#else
 static bool dio_states[NUM_DIO] = {0};
+#endif
 
 static void hal_io_check() {
     uint8_t i;
@@ -80,11 +102,26 @@ static void hal_spi_init () {
     SPI.begin();
 }
 
-void hal_pin_nss (u1_t val) {
-    if (!val)
+static uint8_t spilevel = 0;
+
+void hal_spi_begin () {
+    if (spilevel++ == 0)
         SPI.beginTransaction(settings);
-    else
+}
+
+void hal_spi_end () {
+    if (--spilevel == 0)
         SPI.endTransaction();
+}
+
+void hal_pin_nss (u1_t val) {
+    // Outside of hal_spi_begin/end, every access is its own transaction
+    if (spilevel == 0) {
+        if (!val)
+            SPI.beginTransaction(settings);
+        else
+            SPI.endTransaction();
+    }
 
     //Serial.println(val?">>":"<<");
     digitalWrite(lmic_pins.nss, val);
@@ -102,6 +139,28 @@ u1_t hal_spi (u1_t out) {
     return res;
 }
 
+// perform SPI burst transaction with radio, moving the whole buffer in
+// one block transfer instead of one transfer call per byte
+void hal_spi_burst (u1_t addr, u1_t* buf, u1_t len, u1_t dir) {
+    hal_pin_nss(0);
+    SPI.transfer(addr);
+    if (dir == HAL_SPI_WRITE) {
+#if defined(STM32_CORE_VERSION) && (STM32_CORE_VERSION >= 0x02070000)
+        // Don't overwrite buf with the (meaningless) received bytes. Before
+        // core 2.7.0 the third argument is a SPITransferMode (SPI_CONTINUE,
+        // SPI_LAST), so the older cores write byte by byte.
+        SPI.transfer(buf, len, SPI_TRANSMITONLY);
+#else
+        for (u1_t i = 0; i < len; i++)
+            SPI.transfer(buf[i]);
+#endif
+    } else {
+        memset(buf, 0x00, len);
+        SPI.transfer(buf, len);
+    }
+    hal_pin_nss(1);
+}
+
 // -----------------------------------------------------------------------------
 // TIME
 
@@ -109,6 +168,13 @@ static void hal_time_init () {
     // Nothing to do
 }
 
+// Time hal_addTicks() made up for, micros() does not count in stop mode
+static u4_t skippedTicks;
+
+void hal_addTicks (u4_t ticks) {
+    skippedTicks += ticks;
+}
+
 u4_t hal_ticks () {
     // Because micros() is scaled down in this function, micros() will
     // overflow before the tick timer should, causing the tick timer to
@@ -147,7 +213,7 @@ u4_t hal_ticks () {
     // Return the scaled value with the upper bits of stored added. The
     // overlapping bit will be equal and the lower bits will be 0, so
     // bitwise or is a no-op for them.
-    return scaled | ((uint32_t)overflow << 24);
+    return (scaled | ((uint32_t)overflow << 24)) + skippedTicks;
 
     // 0 leads to correct, but overly complex code (it could just return
     // micros() unmodified), 8 leaves no room for the overlapping bit.
@@ -160,21 +226,64 @@ static s4_t delta_time(u4_t time) {
     return (s4_t)(time - hal_ticks());
 }
 
+#if defined(ARDUINO_ARCH_STM32)
+// Count a SysTick that is pending while interrupts are masked, like its
+// handler would, so micros() goes on within hal_disableIRQs(). The other
+// interrupts wait for the end of the section.
+static void hal_countSysTick () {
+#if defined(SCB_ICSR_PENDSTSET_Msk)
+    if (__get_PRIMASK() && (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)) {
+        SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk;
+        HAL_IncTick();
+    }
+#endif
+}
+#endif
+
+// Sleep the core until the next interrupt. SysTick fires every millisecond
+// on STM32, so this returns within 1 ms: waiting with it is a 1 ms poll
+// that sleeps in between, not a compare match at the target time.
+static void hal_idle () {
+#if defined(ARDUINO_ARCH_STM32)
+    if (__get_PRIMASK() == 0) {
+        // WFI also wakes up on an interrupt that is pending but masked.
+        // Entering it with interrupts masked avoids sleeping through an
+        // interrupt that fires just before, unmasking services it.
+        __disable_irq();
+        __WFI();
+        __enable_irq();
+    } else {
+        // Within hal_disableIRQs(), e.g. radio_init(): stay masked, the
+        // section must not be broken up. The pending SysTick still wakes
+        // the core.
+        __WFI();
+        hal_countSysTick();
+    }
+#else
+    delay(1);
+#endif
+}
+
+// Margin for sleeping: one SysTick period plus the wakeup latency.
+#define IDLE_GUARD_TICKS ((1000 + 100) / US_PER_OSTICK)
+
 void hal_waitUntil (u4_t time) {
-    s4_t delta = delta_time(time);
-    // From delayMicroseconds docs: Currently, the largest value that
-    // will produce an accurate delay is 16383.
-    while (delta > (16000 / US_PER_OSTICK)) {
-        delay(16);
-        delta -= (16000 / US_PER_OSTICK);
+    // Poll every millisecond, sleeping between the SysTicks, as long as
+    // the next one is sure to come before the target, then spin on the
+    // tick counter for the last part. This returns at most one tick late,
+    // instead of sleeping blind in delay() chunks.
+    while (delta_time(time) > IDLE_GUARD_TICKS)
+        hal_idle();
+    while (delta_time(time) > 0) {
+#if defined(ARDUINO_ARCH_STM32)
+        hal_countSysTick();
+#endif
     }
-    if (delta > 0)
-        delayMicroseconds(delta * US_PER_OSTICK);
 }
 
 // check and rewind for target time
 u1_t hal_checkTimer (u4_t time) {
-    // No need to schedule wakeup, since we're not sleeping
+    // No need to schedule wakeup, hal_sleep() wakes up on the next SysTick
     return delta_time(time) <= 0;
 }
 
@@ -201,9 +310,14 @@ void hal_enableIRQs () {
     }
 }
 
-void hal_sleep ()
+// Weak, a board that can sleep through to the next job replaces it
+__attribute__((weak)) void hal_sleep ()
 {
-    // Not implemented
+#if defined(ARDUINO_ARCH_STM32)
+    // Nothing to run: sleep until the next SysTick or a DIO edge instead
+    // of spinning, the run loop then checks the timed jobs again.
+    hal_idle();
+#endif
 }
 
 // -----------------------------------------------------------------------------
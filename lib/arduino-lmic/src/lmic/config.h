@@ -45,6 +45,16 @@
 // Requires ping to be disabled too
 //#define DISABLE_BEACONS
 
+// Uncomment this to disable measuring the clock drift on received
+// downlinks. Without it the RX windows are always widened by the full
+// error passed to LMIC_setClockError().
+//#define DISABLE_CLOCK_CAL
+
+// Uncomment this to always calculate the airtime of a frame, instead of
+// looking it up in tables of all frame lengths for the uplink data rates
+// (about 1.8 kB of flash for EU868).
+//#define DISABLE_AIRTIME_TABLE
+
 // Uncomment these to disable the corresponding MAC commands.
 // Class A
 //#define DISABLE_MCMD_DCAP_REQ // duty cycle cap
@@ -65,8 +75,26 @@
 // example).
 //#define DISABLE_INVERT_IQ_ON_RX
 
+// Uncomment this to always access the radio registers over SPI, instead
+// of keeping a RAM copy of the configuration registers that saves
+// rewriting unchanged values and reading them back.
+//#define DISABLE_RADIO_SHADOW
+// Uncomment this to check the RAM copy against the radio on every access
+// it saves. Only useful for debugging, as this does all the SPI traffic
+// again.
+//#define CHECK_RADIO_SHADOW
+
+// Define this (on the compiler command line) to keep all state of the
+// stack in a lmic_ctx_t reached through the LMIC_CTX pointer, so one
+// process can run many stacks, e.g. to simulate a fleet of nodes. See
+// oslmic.h. Costs an indirection on every access, so not for the node.
+//#define LMIC_MULTI_INSTANCE
+
 // This allows choosing between multiple included AES implementations.
-// Make sure exactly one of these is uncommented.
+// Make sure exactly one of these is uncommented. Defining one of them on
+// the compiler command line (e.g. -D USE_ORIGINAL_AES) overrides the
+// choice made here.
+#if !defined(USE_ORIGINAL_AES) && !defined(USE_IDEETRON_AES) && !defined(USE_M0PLUS_AES)
 //
 // This selects the original AES implementation included LMIC. This
 // implementation is optimized for speed on 32-bit processors using
@@ -79,5 +107,18 @@
 // byte-oriented ones, making it use a lot less flash space (but it is
 // also about twice as slow as the original).
 #define USE_IDEETRON_AES
+//
+// This selects an implementation for 32-bit cores without much flash,
+// like the Cortex-M0+. It works on whole state columns at once and only
+// needs the 256 byte S-box, so it is about as small as the Ideetron one
+// and a lot faster on the host. Not measured on the node yet.
+// #define USE_M0PLUS_AES
+#endif
+//
+// With the Ideetron or Cortex-M0+ implementation, this keeps the
+// expanded key schedule of the two most recently used keys (the network
+// and application session keys) in RAM, so the round keys are not
+// calculated again for every block. Costs 352 bytes of RAM.
+//#define AES_KEY_SCHEDULE
 
 #endif // _lmic_config_h_
@@ -43,6 +43,29 @@ void hal_pin_rst (u1_t val);
  */
 u1_t hal_spi (u1_t outval);
 
+enum { HAL_SPI_READ = 0, HAL_SPI_WRITE = 1 };
+
+/*
+ * perform SPI burst transaction with radio.
+ *   - select radio, write byte 'addr'
+ *   - HAL_SPI_WRITE: write 'len' bytes from 'buf'
+ *   - HAL_SPI_READ: read 'len' bytes into 'buf'
+ *   - deselect radio
+ */
+void hal_spi_burst (u1_t addr, u1_t* buf, u1_t len, u1_t dir);
+
+/*
+ * claim SPI bus for a sequence of radio accesses.
+ *   - might be invoked nested
+ *   - will be followed by matching call to hal_spi_end()
+ */
+void hal_spi_begin (void);
+
+/*
+ * release SPI bus.
+ */
+void hal_spi_end (void);
+
 /*
  * disable all CPU interrupts.
  *   - might be invoked nested
@@ -66,7 +89,15 @@ void hal_sleep (void);
 u4_t hal_ticks (void);
 
 /*
- * busy-wait until specified timestamp (in ticks) is reached.
+ * advance the system time by ticks it did not count.
+ *   - for low-power modes that stop the timer behind hal_ticks()
+ */
+void hal_addTicks (u4_t ticks);
+
+/*
+ * wait until specified timestamp (in ticks) is reached.
+ *   - may put the CPU to sleep in between
+ *   - returns at most one tick late
  */
 void hal_waitUntil (u4_t time);
 
@@ -190,6 +190,26 @@ static void aes_cipher (xref2cu1_t key, u4_t devaddr, u4_t seqno, int dndir, xre
 }
 
 
+// Encrypt the payload at pdu[off..len) and append the MIC over pdu[0..len)
+static void aes_cipherAppendMic (xref2cu1_t key, u4_t devaddr, u4_t seqno, int dndir, xref2u1_t pdu, int off, int len) {
+#if defined(USE_ORIGINAL_AES)
+    aes_cipher(key, devaddr, seqno, dndir, pdu+off, len-off);
+    aes_appendMic(LMIC.nwkKey, devaddr, seqno, dndir, pdu, len);
+#else
+    u1_t ctr[16];
+    os_clearMem(ctr, 16);
+    ctr[0] = ctr[15] = 1; // mode=cipher / block counter=1
+    ctr[5] = dndir?1:0;
+    os_wlsbf4(ctr+ 6,devaddr);
+    os_wlsbf4(ctr+10,seqno);
+    micB0(devaddr, seqno, dndir, len);
+    os_copyMem(AESkey,LMIC.nwkKey,16);
+    // MSB because of internal structure of AES
+    os_wmsbf4(pdu+len, os_aes_ctrmic(key, ctr, pdu, off, len));
+#endif
+}
+
+
 static void aes_sessKeys (u2_t devnonce, xref2cu1_t artnonce, xref2u1_t nwkkey, xref2u1_t artkey) {
     os_clearMem(nwkkey, 16);
     nwkkey[0] = 0x01;
@@ -278,7 +298,76 @@ int getSensitivity (rps_t rps) {
     return -141 + TABLE_GET_U1_TWODIM(SENSITIVITY, getSf(rps), getBw(rps));
 }
 
+#if !defined(DISABLE_AIRTIME_TABLE)
+// Airtime of all frame lengths for the rps of the uplink data rates (CR 4/5,
+// CRC, explicit header), computed by the compiler with the same integer
+// arithmetic as calcAirTime() below. sf is the spreading factor 7..12, bw
+// the bandwidth 0,1,2 = 125,250,500kHz.
+#define AT_PSYM(sf,plen)  (8*(plen) - 4*(sf) + 28 + 16)
+#define AT_Q(sf)          (4*(sf) - ((sf) >= 11 ? 8 : 0))
+#define AT_NSYM(sf,plen)  (AT_PSYM(sf,plen) > 0 ? (AT_PSYM(sf,plen) + AT_Q(sf) - 1) / AT_Q(sf) * 5 + 8 : 8)
+#define AT_SFX(sf,bw)     ((sf)-5-(bw) > 4 ? 4 : (sf)-5-(bw))
+#define AT_DIV(sf,bw)     (15625 >> ((sf)-5-(bw) > 4 ? (sf)-5-(bw)-4 : 0))
+#define AT(sf,bw,plen)    ((((ostime_t)((AT_NSYM(sf,plen)<<2) + 49) << AT_SFX(sf,bw)) * OSTICKS_PER_SEC \
+                            + AT_DIV(sf,bw)/2) / AT_DIV(sf,bw))
+#define AT4(sf,bw,p)      AT(sf,bw,p), AT(sf,bw,p+1), AT(sf,bw,p+2), AT(sf,bw,p+3)
+#define AT16(sf,bw,p)     AT4(sf,bw,p), AT4(sf,bw,p+4), AT4(sf,bw,p+8), AT4(sf,bw,p+12)
+#define AT_ROW(sf,bw)     { AT16(sf,bw,0), AT16(sf,bw,16), AT16(sf,bw,32), AT16(sf,bw,48), AT(sf,bw,64) }
+enum { AIRTIME_LENS = 65 };
+
+#if defined(CFG_eu868)
+static CONST_TABLE(ostime_t, AIRTIMES)[][AIRTIME_LENS] = {
+    AT_ROW( 7,0), AT_ROW( 8,0), AT_ROW( 9,0), AT_ROW(10,0), AT_ROW(11,0), AT_ROW(12,0),
+    AT_ROW( 7,1)
+};
+
+// Row of AIRTIMES for rps, -1 if there is none
+static int airtimeRow (rps_t rps) {
+    if( (rps >> 5) != 0 )  // other CR, no CRC or implicit header
+        return -1;
+    sf_t sf = getSf(rps);
+    bw_t bw = getBw(rps);
+    if( sf == FSK || sf == SFrfu )
+        return -1;
+    if( bw == BW125 )
+        return sf - SF7;
+    return bw == BW250 && sf == SF7 ? 6 : -1;
+}
+#elif defined(CFG_us915)
+static CONST_TABLE(ostime_t, AIRTIMES)[][AIRTIME_LENS] = {
+    AT_ROW( 7,0), AT_ROW( 8,0), AT_ROW( 9,0), AT_ROW(10,0),
+    AT_ROW( 7,2), AT_ROW( 8,2), AT_ROW( 9,2), AT_ROW(10,2), AT_ROW(11,2), AT_ROW(12,2)
+};
+
+static int airtimeRow (rps_t rps) {
+    if( (rps >> 5) != 0 )
+        return -1;
+    sf_t sf = getSf(rps);
+    bw_t bw = getBw(rps);
+    if( sf == FSK || sf == SFrfu )
+        return -1;
+    if( bw == BW125 )
+        return sf <= SF10 ? sf - SF7 : -1;
+    return bw == BW500 ? 4 + sf - SF7 : -1;
+}
+#endif
+#undef AT_PSYM
+#undef AT_Q
+#undef AT_NSYM
+#undef AT_SFX
+#undef AT_DIV
+#undef AT
+#undef AT4
+#undef AT16
+#undef AT_ROW
+#endif // !DISABLE_AIRTIME_TABLE
+
 ostime_t calcAirTime (rps_t rps, u1_t plen) {
+#if !defined(DISABLE_AIRTIME_TABLE)
+    int row = airtimeRow(rps);
+    if( row >= 0 && plen < AIRTIME_LENS )
+        return TABLE_GET_OSTIME_TWODIM(AIRTIMES, row, plen);
+#endif
     u1_t bw = getBw(rps);  // 0,1,2 = 125,250,500kHz
     u1_t sf = getSf(rps);  // 0=FSK, 1..6 = SF7..12
     if( sf == FSK ) {
@@ -542,6 +631,21 @@ static CONST_TABLE(u4_t, iniChannelFreq)[6] = {
     EU868_F1|BAND_CENTI, EU868_F2|BAND_CENTI, EU868_F3|BAND_CENTI,
 };
 
+// Bring channel chnl up to date in the masks nextTx() selects from, after
+// its frequency or DR map changed
+static void updateChnlMasks (u1_t chnl) {
+    u2_t bit = 1<<chnl;
+    for( u1_t b=0; b<MAX_BANDS; b++ )
+        LMIC.bandChnls[b] &= ~bit;
+    for( u1_t dr=0; dr<16; dr++ ) {
+        if( (LMIC.channelDrMap[chnl] & (1<<dr)) != 0 )
+            LMIC.drChnls[dr] |= bit;
+        else
+            LMIC.drChnls[dr] &= ~bit;
+    }
+    LMIC.bandChnls[LMIC.channelFreq[chnl] & 0x3] |= bit;
+}
+
 static void initDefaultChannels (bit_t join) {
     os_clearMem(&LMIC.channelFreq, sizeof(LMIC.channelFreq));
     os_clearMem(&LMIC.channelDrMap, sizeof(LMIC.channelDrMap));
@@ -553,6 +657,9 @@ static void initDefaultChannels (bit_t join) {
         LMIC.channelFreq[fu]  = TABLE_GET_U4(iniChannelFreq, su);
         LMIC.channelDrMap[fu] = DR_RANGE_MAP(DR_SF12,DR_SF7);
     }
+    for( u1_t ch=0; ch<MAX_CHANNELS; ch++ )
+        updateChnlMasks(ch);
+    LMIC.adrTxPow = 14;
 
     LMIC.bands[BAND_MILLI].txcap    = 1000;  // 0.1%
     LMIC.bands[BAND_MILLI].txpow    = 14;
@@ -596,6 +703,7 @@ bit_t LMIC_setupChannel (u1_t chidx, u4_t freq, u2_t drmap, s1_t band) {
     LMIC.channelFreq [chidx] = freq;
     LMIC.channelDrMap[chidx] = drmap==0 ? DR_RANGE_MAP(DR_SF12,DR_SF7) : drmap;
     LMIC.channelMap |= 1<<chidx;  // enabled right away
+    updateChnlMasks(chidx);
     return 1;
 }
 
@@ -603,6 +711,7 @@ void LMIC_disableChannel (u1_t channel) {
     LMIC.channelFreq[channel] = 0;
     LMIC.channelDrMap[channel] = 0;
     LMIC.channelMap &= ~(1<<channel);
+    updateChnlMasks(channel);
 }
 
 static u4_t convFreq (xref2u1_t ptr) {
@@ -632,7 +741,8 @@ static void updateTx (ostime_t txbeg) {
     // Update channel/global duty cycle stats
     xref2band_t band = &LMIC.bands[freq & 0x3];
     LMIC.freq  = freq & ~(u4_t)3;
-    LMIC.txpow = band->txpow;
+    // the band limit, or less if the network or the application asked for it
+    LMIC.txpow = band->txpow < LMIC.adrTxPow ? band->txpow : LMIC.adrTxPow;
     band->avail = txbeg + airtime * band->txcap;
     if( LMIC.globalDutyRate != 0 )
         LMIC.globalDutyAvail = txbeg + (airtime<<LMIC.globalDutyRate);
@@ -644,38 +754,38 @@ static void updateTx (ostime_t txbeg) {
 }
 
 static ostime_t nextTx (ostime_t now) {
-    u1_t bmap=0xF;
-    do {
-        ostime_t mintime = now + /*8h*/sec2osticks(28800);
-        u1_t band=0;
-        for( u1_t bi=0; bi<4; bi++ ) {
-            if( (bmap & (1<<bi)) && mintime - LMIC.bands[bi].avail > 0 ) {
-                #if LMIC_DEBUG_LEVEL > 1
-                    lmic_printf("%lu: Considering band %d, which is available at %lu\n", os_getTime(), bi, LMIC.bands[bi].avail);
-                #endif
-                mintime = LMIC.bands[band = bi].avail;
-            }
-        }
-        // Find next channel in given band
-        u1_t chnl = LMIC.bands[band].lastchnl;
-        for( u1_t ci=0; ci<MAX_CHANNELS; ci++ ) {
-            if( (chnl = (chnl+1)) >= MAX_CHANNELS )
-                chnl -=  MAX_CHANNELS;
-            if( (LMIC.channelMap & (1<<chnl)) != 0  &&  // channel enabled
-                (LMIC.channelDrMap[chnl] & (1<<(LMIC.datarate&0xF))) != 0  &&
-                band == (LMIC.channelFreq[chnl] & 0x3) ) { // in selected band
-                LMIC.txChnl = LMIC.bands[band].lastchnl = chnl;
-                return mintime;
-            }
+    // Enabled channels that allow the current DR, the band of each is
+    // considered only if it has one of them
+    u2_t usable = LMIC.channelMap & LMIC.drChnls[LMIC.datarate&0xF];
+    ostime_t mintime = now + /*8h*/sec2osticks(28800);
+    u1_t band = MAX_BANDS;
+    for( u1_t bi=0; bi<MAX_BANDS; bi++ ) {
+        if( (usable & LMIC.bandChnls[bi]) != 0 && mintime - LMIC.bands[bi].avail > 0 ) {
+            #if LMIC_DEBUG_LEVEL > 1
+                lmic_printf("%lu: Considering band %d, which is available at %lu\n", os_getTime(), bi, LMIC.bands[bi].avail);
+            #endif
+            mintime = LMIC.bands[band = bi].avail;
         }
+    }
+    if( band == MAX_BANDS ) {
         #if LMIC_DEBUG_LEVEL > 1
-            lmic_printf("%lu: No channel found in band %d\n", os_getTime(), band);
+            lmic_printf("%lu: No channel found\n", os_getTime());
         #endif
-        if( (bmap &= ~(1<<band)) == 0 ) {
-            // No feasible channel  found!
-            return mintime;
-        }
-    } while(1);
+        // No feasible channel  found!
+        return mintime;
+    }
+    // Next channel in the band after the last one used: rotate the
+    // candidates so that one is bit 0, and count the zeros up to the first
+    u2_t chnls = usable & LMIC.bandChnls[band];
+    u1_t start = LMIC.bands[band].lastchnl + 1;
+    if( start >= MAX_CHANNELS )
+        start -= MAX_CHANNELS;
+    u2_t rot = (u2_t)((chnls >> start) | (chnls << (MAX_CHANNELS - start)));
+    u1_t chnl = start + __builtin_ctz(rot);
+    if( chnl >= MAX_CHANNELS )
+        chnl -= MAX_CHANNELS;
+    LMIC.txChnl = LMIC.bands[band].lastchnl = chnl;
+    return mintime;
 }
 
 
@@ -1032,6 +1142,61 @@ static int decodeBeacon (void) {
 #endif // !DISABLE_BEACONS
 
 
+#if !defined(DISABLE_CLOCK_CAL)
+// Minimum clock error kept once calibrated (0.1%). Covers the tick
+// resolution and the latency of polling the DIO lines.
+#define CLOCK_ERROR_MIN  (MAX_CLOCK_ERROR/1000)
+
+static void updateClockError (void) {
+    u4_t err = 4*(u4_t)LMIC.clockDev + CLOCK_ERROR_MIN;
+    LMIC.clockError = err < LMIC.clockErrorMax ? err : LMIC.clockErrorMax;
+}
+
+// Compare the start of the downlink just received in RX1/RX2 with the
+// start expected for a perfect clock and fold the result into the drift
+// estimate. schedRx12 shifts the window by the drift and only widens it
+// by the remaining uncertainty.
+static void calibrateClock (void) {
+    ostime_t delay = LMIC.rxexp - LMIC.txend;
+    if( LMIC.clockErrorMax == 0 || delay <= 0 )
+        return;
+    ostime_t offset = LMIC.rxtime - calcAirTime(LMIC.rps, LMIC.dataLen) - LMIC.rxexp;
+    s4_t sample = (int64_t)offset * MAX_CLOCK_ERROR / delay;
+    if( sample > LMIC.clockErrorMax || sample < -(s4_t)LMIC.clockErrorMax )
+        return;  // cannot have been received in this window, bogus
+    if( LMIC.clockCalCnt == 0 ) {
+        // Start from a window as wide as configured and shrink it by a
+        // quarter with every downlink that confirms the estimate.
+        LMIC.clockDrift = sample;
+        LMIC.clockDev   = LMIC.clockErrorMax / 4;
+    } else {
+        s4_t diff = sample - LMIC.clockDrift;
+        LMIC.clockDrift += diff / 4;
+        if( diff < 0 )
+            diff = -diff;
+        LMIC.clockDev = (s4_t)LMIC.clockDev + (diff - (s4_t)LMIC.clockDev) / 4;
+    }
+    if( LMIC.clockCalCnt < 255 )
+        LMIC.clockCalCnt++;
+    updateClockError();
+#if LMIC_DEBUG_LEVEL > 1
+    lmic_printf("%lu: Clock drift: offset=%ld drift=%ld clockError=%u\n",
+                os_getTime(), (long)offset, (long)LMIC.clockDrift, LMIC.clockError);
+#endif
+}
+
+// Nothing received in either window. The estimate may have gone stale
+// (e.g. temperature change), so slowly open the windows again.
+static void clockCalMissed (void) {
+    if( LMIC.clockCalCnt == 0 )
+        return;
+    u4_t dev = LMIC.clockDev + LMIC.clockDev/16 + 1;
+    LMIC.clockDev = dev < LMIC.clockErrorMax ? dev : LMIC.clockErrorMax;
+    updateClockError();
+}
+#endif // !DISABLE_CLOCK_CAL
+
+
 static bit_t decodeFrame (void) {
     xref2u1_t d = LMIC.frame;
     u1_t hdr    = d[0];
@@ -1093,6 +1258,10 @@ static bit_t decodeFrame (void) {
                            e_.info3  = LMIC.devaddr));
         goto norx;
     }
+#if !defined(DISABLE_CLOCK_CAL)
+    if( (LMIC.txrxFlags & (TXRX_DNW1|TXRX_DNW2)) != 0 )
+        calibrateClock();
+#endif
     if( seqno < LMIC.seqnoDn ) {
         if( (s4_t)seqno > (s4_t)LMIC.seqnoDn ) {
             EV(specCond, INFO, (e_.reason = EV::specCond_t::DNSEQNO_ROLL_OVER,
@@ -1142,8 +1311,8 @@ static bit_t decodeFrame (void) {
     while( oidx < olen ) {
         switch( opts[oidx] ) {
         case MCMD_LCHK_ANS: {
-            //int gwmargin = opts[oidx+1];
-            //int ngws = opts[oidx+2];
+            LMIC.lchkMargin = opts[oidx+1];
+            LMIC.lchkGws    = opts[oidx+2];
             oidx += 3;
             continue;
         }
@@ -1352,9 +1521,18 @@ static void setupRx2 (void) {
 
 static void schedRx12 (ostime_t delay, osjobcb_t func, u1_t dr) {
     ostime_t hsym = dr2hsym(dr);
+    ostime_t skew = 0;
 
     LMIC.rxsyms = MINRX_SYMS;
 
+#if !defined(DISABLE_CLOCK_CAL)
+    LMIC.rxexp = LMIC.txend + delay;
+    // Move the window by the drift measured on earlier downlinks,
+    // LMIC.clockError then only covers the residual uncertainty.
+    if( LMIC.clockCalCnt != 0 )
+        skew = (int64_t)delay * LMIC.clockDrift / MAX_CLOCK_ERROR;
+#endif
+
     // If a clock error is specified, compensate for it by extending the
     // receive window
     if (LMIC.clockError != 0) {
@@ -1378,7 +1556,7 @@ static void schedRx12 (ostime_t delay, osjobcb_t func, u1_t dr) {
 
     // Center the receive window on the center of the expected preamble
     // (again note that hsym is half a sumbol time, so no /2 needed)
-    LMIC.rxtime = LMIC.txend + delay + PAMBL_SYMS * hsym - LMIC.rxsyms * hsym;
+    LMIC.rxtime = LMIC.txend + delay + skew + PAMBL_SYMS * hsym - LMIC.rxsyms * hsym;
 
     os_setTimedCallback(&LMIC.osjob, LMIC.rxtime - RX_RAMPUP, func);
 }
@@ -1583,6 +1761,9 @@ static void processRx2DnData (xref2osjob_t osjob) {
         // until DNW2_SAFETY_ZONE from now, and add up to 2 seconds of
         // extra randomization.
         txDelay(os_getTime() + DNW2_SAFETY_ZONE, 2);
+#if !defined(DISABLE_CLOCK_CAL)
+        clockCalMissed();
+#endif
     }
     processDnData();
 }
@@ -1682,6 +1863,14 @@ static void buildDataFrame (void) {
         LMIC.snchAns = 0;
     }
 #endif // !DISABLE_MCMD_SNCH_REQ
+    // An answer only belongs to the uplink that asked for it
+    LMIC.lchkGws = 0;
+    LMIC.lchkMargin = 255;
+    if( LMIC.lchkReq ) {
+        LMIC.frame[end] = MCMD_LCHK_REQ;
+        end += 1;
+        LMIC.lchkReq = 0;
+    }
     ASSERT(end <= OFF_DAT_OPTS+16);
 
     u1_t flen = end + (txdata ? 5+dlen : 4);
@@ -1720,11 +1909,13 @@ static void buildDataFrame (void) {
         }
         LMIC.frame[end] = LMIC.pendTxPort;
         os_copyMem(LMIC.frame+end+1, LMIC.pendTxData, dlen);
-        aes_cipher(LMIC.pendTxPort==0 ? LMIC.nwkKey : LMIC.artKey,
-                   LMIC.devaddr, LMIC.seqnoUp-1,
-                   /*up*/0, LMIC.frame+end+1, dlen);
+        // Encrypt the payload and MIC the frame in one pass
+        aes_cipherAppendMic(LMIC.pendTxPort==0 ? LMIC.nwkKey : LMIC.artKey,
+                            LMIC.devaddr, LMIC.seqnoUp-1,
+                            /*up*/0, LMIC.frame, end+1, flen-4);
+    } else {
+        aes_appendMic(LMIC.nwkKey, LMIC.devaddr, LMIC.seqnoUp-1, /*up*/0, LMIC.frame, flen-4);
     }
-    aes_appendMic(LMIC.nwkKey, LMIC.devaddr, LMIC.seqnoUp-1, /*up*/0, LMIC.frame, flen-4);
 
     EV(dfinfo, DEBUG, (e_.deveui  = MAIN::CDEV->getEui(),
                        e_.devaddr = LMIC.devaddr,
@@ -2031,6 +2222,13 @@ static void startRxPing (xref2osjob_t osjob) {
 
 
 // Decide what to do next for the MAC layer of a device
+// Wake up the radio and load the modem settings for the coming TX, so the
+// oscillator starts up while the frame is built and encrypted.
+static void prepareTx (dr_t txdr) {
+    LMIC.rps = setCr(updr2rps(txdr), (cr_t)LMIC.errcr);
+    os_radio(RADIO_TXPREP);
+}
+
 static void engineUpdate (void) {
 #if LMIC_DEBUG_LEVEL > 0
     lmic_printf("%lu: engineUpdate, opmode=0x%x\n", os_getTime(), LMIC.opmode);
@@ -2122,6 +2320,7 @@ static void engineUpdate (void) {
                 } else {
                     ftype = HDR_FTYPE_JREQ;
                 }
+                prepareTx(txdr);
                 buildJoinRequest(ftype);
                 LMIC.osjob.func = FUNC_ADDR(jreqDone);
             } else
@@ -2148,10 +2347,10 @@ static void engineUpdate (void) {
                     // App code might do some stuff after send unaware of RESET.
                     goto reset;
                 }
+                prepareTx(txdr);
                 buildDataFrame();
                 LMIC.osjob.func = FUNC_ADDR(updataDone);
             }
-            LMIC.rps    = setCr(updr2rps(txdr), (cr_t)LMIC.errcr);
             LMIC.dndr   = txdr;  // carry TX datarate (can be != LMIC.datarate) over to txDone/setupRx1
             LMIC.opmode = (LMIC.opmode & ~(OP_POLL|OP_RNDTX)) | OP_TXRXPEND | OP_NEXTCHNL;
             updateTx(txbeg);
@@ -2244,7 +2443,19 @@ void LMIC_reset (void) {
     os_radio(RADIO_RST);
     os_clearCallback(&LMIC.osjob);
 
+#if !defined(DISABLE_CLOCK_CAL)
+    // The clock calibration describes this board, not the session,
+    // so keep it across a reset.
+    s4_t clockDrift  = LMIC.clockDrift;
+    u2_t clockDev    = LMIC.clockDev;
+    u1_t clockCalCnt = LMIC.clockCalCnt;
+#endif
     os_clearMem((xref2u1_t)&LMIC,SIZEOFEXPR(LMIC));
+#if !defined(DISABLE_CLOCK_CAL)
+    LMIC.clockDrift  = clockDrift;
+    LMIC.clockDev    = clockDev;
+    LMIC.clockCalCnt = clockCalCnt;
+#endif
     LMIC.devaddr      =  0;
     LMIC.devNonce     =  os_getRndU2();
     LMIC.opmode       =  OP_NONE;
@@ -2317,6 +2528,13 @@ void LMIC_sendAlive (void) {
     engineUpdate();
 }
 
+// Add a link check request to the next UP frame. The answer, if any, is
+// in LMIC.lchkMargin/lchkGws when EV_TXCOMPLETE is reported, until the
+// next UP frame is built.
+void LMIC_requestLinkCheck (void) {
+    LMIC.lchkReq = 1;
+}
+
 
 // Check if other networks are around.
 void LMIC_tryRejoin (void) {
@@ -2377,6 +2595,222 @@ void LMIC_setLinkCheckMode (bit_t enabled) {
 // Sets the max clock error to compensate for (defaults to 0, which
 // allows for +/- 640 at SF7BW250). MAX_CLOCK_ERROR represents +/-100%,
 // so e.g. for a +/-1% error you would pass MAX_CLOCK_ERROR * 1 / 100.
+// Unless DISABLE_CLOCK_CAL is set, this is only the starting value: the
+// drift measured on received downlinks narrows the RX windows from there.
 void LMIC_setClockError(u2_t error) {
     LMIC.clockError = error;
+#if !defined(DISABLE_CLOCK_CAL)
+    LMIC.clockErrorMax = error;
+    if( LMIC.clockCalCnt != 0 )
+        updateClockError();
+#endif
+}
+
+// ================================================================================
+// Session persistence
+//
+// LMIC_saveSession() writes everything needed to continue a session after
+// the MCU lost its RAM (standby/shutdown, reset) into LMIC_SESSION_SIZE
+// bytes or less, LMIC_restoreSession() reads it back after LMIC_reset()
+// and LMIC_setClockError(). Times are saved relative to now, and the
+// caller tells on restore how much time passed in between. Settings made
+// before the restore (LMIC_setSession, LMIC_setAdrMode, ...) are
+// overwritten with the saved values.
+
+static xref2u1_t putU1 (xref2u1_t p, u1_t v) { *p = v; return p+1; }
+static xref2u1_t putU2 (xref2u1_t p, u2_t v) { os_wlsbf2(p, v); return p+2; }
+static xref2u1_t putU4 (xref2u1_t p, u4_t v) { os_wlsbf4(p, v); return p+4; }
+
+// Time left until t, 0 if already passed
+static xref2u1_t putTime (xref2u1_t p, ostime_t t, ostime_t now) {
+    return putU4(p, t - now > 0 ? t - now : 0);
+}
+
+static ostime_t getTime (xref2cu1_t p, ostime_t now, ostime_t elapsed) {
+    s4_t left = (s4_t)os_rlsbf4(p);
+    return now + (left > elapsed ? left - elapsed : 0);
+}
+
+u1_t LMIC_saveSession (xref2u1_t buf) {
+    ostime_t now = os_getTime();
+    xref2u1_t p = buf;
+
+    p = putU1(p, LMIC_SESSION_VERSION);
+    p = putU4(p, LMIC.netid);
+    p = putU4(p, LMIC.devaddr);
+    os_copyMem(p, LMIC.nwkKey, 16); p += 16;
+    os_copyMem(p, LMIC.artKey, 16); p += 16;
+    p = putU4(p, LMIC.seqnoUp);
+    p = putU4(p, LMIC.seqnoDn);
+
+#if defined(CFG_eu868)
+    // only the defined channels
+    p = putU2(p, LMIC.channelMap);
+    xref2u1_t nch = p++;
+    *nch = 0;
+    for( u1_t ch=0; ch<MAX_CHANNELS; ch++ ) {
+        if( LMIC.channelFreq[ch] == 0 )
+            continue;
+        p = putU1(p, ch);
+        p = putU4(p, LMIC.channelFreq[ch]);
+        p = putU2(p, LMIC.channelDrMap[ch]);
+        *nch += 1;
+    }
+    for( u1_t b=0; b<MAX_BANDS; b++ ) {
+        p = putU2(p, LMIC.bands[b].txcap);
+        p = putU1(p, LMIC.bands[b].txpow);
+        p = putU1(p, LMIC.bands[b].lastchnl);
+        p = putTime(p, LMIC.bands[b].avail, now);
+    }
+#elif defined(CFG_us915)
+    for( u1_t i=0; i<(72+MAX_XCHANNELS+15)/16; i++ )
+        p = putU2(p, LMIC.channelMap[i]);
+    for( u1_t i=0; i<MAX_XCHANNELS; i++ ) {
+        p = putU4(p, LMIC.xchFreq[i]);
+        p = putU2(p, LMIC.xchDrMap[i]);
+    }
+#endif
+
+    p = putU1(p, LMIC.txChnl);
+    p = putU1(p, LMIC.globalDutyRate);
+    p = putTime(p, LMIC.globalDutyAvail, now);
+    p = putU1(p, LMIC.upRepeat);
+    p = putU1(p, LMIC.adrTxPow);
+    p = putU1(p, LMIC.datarate);
+    p = putU1(p, LMIC.adrAckReq);
+    p = putU1(p, LMIC.adrEnabled);
+    p = putU1(p, LMIC.rxDelay);
+    p = putU1(p, LMIC.dn2Dr);
+    p = putU4(p, LMIC.dn2Freq);
+    p = putU1(p, LMIC.dnConf);
+    u1_t ans = (LMIC.ladrAns ? 1 : 0) | (LMIC.devsAns ? 2 : 0);
+#if !defined(DISABLE_MCMD_DCAP_REQ)
+    ans |= LMIC.dutyCapAns ? 4 : 0;
+#endif
+    p = putU1(p, ans);
+#if !defined(DISABLE_MCMD_SNCH_REQ)
+    p = putU1(p, LMIC.snchAns);
+#else
+    p = putU1(p, 0);
+#endif
+#if !defined(DISABLE_MCMD_DN2P_SET)
+    p = putU1(p, LMIC.dn2Ans);
+#else
+    p = putU1(p, 0);
+#endif
+
+#if !defined(DISABLE_CLOCK_CAL)
+    p = putU4(p, LMIC.clockDrift);
+    p = putU2(p, LMIC.clockDev);
+    p = putU1(p, LMIC.clockCalCnt);
+#else
+    os_clearMem(p, 7); p += 7;
+#endif
+
+    ASSERT(p - buf <= LMIC_SESSION_SIZE);
+    return p - buf;
+}
+
+bit_t LMIC_restoreSession (xref2cu1_t buf, u1_t len, ostime_t elapsed) {
+    ostime_t now = os_getTime();
+    xref2cu1_t p = buf;
+
+    // Check the length first, so a bad buffer leaves LMIC alone
+    u2_t need = 1+4+4+16+16+4+4 + 21 + 7;
+#if defined(CFG_eu868)
+    need += 2+1 + 8*MAX_BANDS;
+    if( len < need || buf[1+4+4+16+16+4+4+2] > MAX_CHANNELS )
+        return 0;
+    need += 7*buf[1+4+4+16+16+4+4+2];
+    if( len < need )
+        return 0;
+    // Channel indices out of range mean a slot of another layout or a
+    // corrupted one, not something to take over
+    for( u1_t i=0; i<buf[1+4+4+16+16+4+4+2]; i++ ) {
+        if( buf[1+4+4+16+16+4+4+2+1 + 7*i] >= MAX_CHANNELS )
+            return 0;
+    }
+    if( buf[need-(21+7)] >= MAX_CHANNELS )
+        return 0;
+#elif defined(CFG_us915)
+    need += 2*((72+MAX_XCHANNELS+15)/16) + 6*MAX_XCHANNELS;
+#endif
+    if( len < need || *p++ != LMIC_SESSION_VERSION )
+        return 0;
+    LMIC.netid   = os_rlsbf4(p); p += 4;
+    LMIC.devaddr = os_rlsbf4(p); p += 4;
+    os_copyMem(LMIC.nwkKey, p, 16); p += 16;
+    os_copyMem(LMIC.artKey, p, 16); p += 16;
+    LMIC.seqnoUp = os_rlsbf4(p); p += 4;
+    LMIC.seqnoDn = os_rlsbf4(p); p += 4;
+
+#if defined(CFG_eu868)
+    LMIC.channelMap = os_rlsbf2(p); p += 2;
+    u1_t nch = *p++;
+    os_clearMem(LMIC.channelFreq, sizeof(LMIC.channelFreq));
+    os_clearMem(LMIC.channelDrMap, sizeof(LMIC.channelDrMap));
+    while( nch-- ) {
+        u1_t ch = *p++;
+        LMIC.channelFreq[ch]  = os_rlsbf4(p); p += 4;
+        LMIC.channelDrMap[ch] = os_rlsbf2(p); p += 2;
+    }
+    for( u1_t ch=0; ch<MAX_CHANNELS; ch++ )
+        updateChnlMasks(ch);
+    for( u1_t b=0; b<MAX_BANDS; b++ ) {
+        LMIC.bands[b].txcap    = os_rlsbf2(p); p += 2;
+        LMIC.bands[b].txpow    = *p++;
+        LMIC.bands[b].lastchnl = *p++;
+        LMIC.bands[b].avail    = getTime(p, now, elapsed); p += 4;
+    }
+#elif defined(CFG_us915)
+    for( u1_t i=0; i<(72+MAX_XCHANNELS+15)/16; i++ ) {
+        LMIC.channelMap[i] = os_rlsbf2(p); p += 2;
+    }
+    for( u1_t i=0; i<MAX_XCHANNELS; i++ ) {
+        LMIC.xchFreq[i]  = os_rlsbf4(p); p += 4;
+        LMIC.xchDrMap[i] = os_rlsbf2(p); p += 2;
+    }
+#endif
+
+    LMIC.txChnl          = *p++;
+    LMIC.globalDutyRate  = *p++;
+    LMIC.globalDutyAvail = getTime(p, now, elapsed); p += 4;
+    LMIC.upRepeat        = *p++;
+    LMIC.adrTxPow        = *p++;
+    LMIC.datarate        = *p++;
+    LMIC.adrAckReq       = *p++;
+    LMIC.adrEnabled      = *p++;
+    LMIC.rxDelay         = *p++;
+    LMIC.dn2Dr           = *p++;
+    LMIC.dn2Freq         = os_rlsbf4(p); p += 4;
+    LMIC.dnConf          = *p++;
+    LMIC.ladrAns         = (*p & 1) != 0;
+    LMIC.devsAns         = (*p & 2) != 0;
+#if !defined(DISABLE_MCMD_DCAP_REQ)
+    LMIC.dutyCapAns      = (*p & 4) != 0;
+#endif
+    p++;
+#if !defined(DISABLE_MCMD_SNCH_REQ)
+    LMIC.snchAns         = *p;
+#endif
+    p++;
+#if !defined(DISABLE_MCMD_DN2P_SET)
+    LMIC.dn2Ans          = *p;
+#endif
+    p++;
+
+#if !defined(DISABLE_CLOCK_CAL)
+    LMIC.clockDrift  = (s4_t)os_rlsbf4(p); p += 4;
+    LMIC.clockDev    = os_rlsbf2(p); p += 2;
+    LMIC.clockCalCnt = *p++;
+    if( LMIC.clockCalCnt != 0 )
+        updateClockError();
+#else
+    p += 7;
+#endif
+
+    // Same as after LMIC_setSession()
+    LMIC.opmode &= ~(OP_JOINING|OP_TRACK|OP_REJOIN|OP_TXRXPEND|OP_PINGINI);
+    LMIC.opmode |= OP_NEXTCHNL;
+    return 1;
 }
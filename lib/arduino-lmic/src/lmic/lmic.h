@@ -107,7 +107,7 @@ struct bcninfo_t {
 #endif // !DISABLE_BEACONS
 
 // purpose of receive window - lmic_t.rxState
-enum { RADIO_RST=0, RADIO_TX=1, RADIO_RX=2, RADIO_RXON=3 };
+enum { RADIO_RST=0, RADIO_TX=1, RADIO_RX=2, RADIO_RXON=3, RADIO_TXPREP=4 };
 // Netid values /  lmic_t.netid
 enum { NETID_NONE=(int)~0U, NETID_MASK=(int)0xFFFFFF };
 // MAC operation modes (lmic_t.opmode).
@@ -168,6 +168,8 @@ struct lmic_t {
     u4_t        channelFreq[MAX_CHANNELS];
     u2_t        channelDrMap[MAX_CHANNELS];
     u2_t        channelMap;
+    u2_t        bandChnls[MAX_BANDS];  // defined channels per band
+    u2_t        drChnls[16];           // defined channels per DR (channelDrMap bits)
 #elif defined(CFG_us915)
     u4_t        xchFreq[MAX_XCHANNELS];    // extra channel frequencies (if device is behind a repeater)
     u2_t        xchDrMap[MAX_XCHANNELS];   // extra channel datarate ranges  ---XXX: ditto
@@ -193,6 +195,13 @@ struct lmic_t {
 
     u2_t        clockError; // Inaccuracy in the clock. CLOCK_ERROR_MAX
                             // represents +/-100% error
+#if !defined(DISABLE_CLOCK_CAL)
+    u2_t        clockErrorMax; // configured clock error, upper bound for clockError
+    ostime_t    rxexp;         // nominal start of downlink in current RX1/RX2 window
+    s4_t        clockDrift;    // measured clock drift (MAX_CLOCK_ERROR scale)
+    u2_t        clockDev;      // mean deviation of drift measurements
+    u1_t        clockCalCnt;   // number of drift measurements (saturates)
+#endif
 
     u1_t        pendTxPort;
     u1_t        pendTxConf;   // confirmed data
@@ -213,6 +222,9 @@ struct lmic_t {
     u1_t        rxDelay;      // Rx delay after TX
     
     u1_t        margin;
+    bit_t       lchkReq;      // link check request pending
+    u1_t        lchkMargin;   // link check answer to the last UP frame: demod margin in dB (255=unknown)
+    u1_t        lchkGws;      //   and number of gateways, 0=no answer
     bit_t       ladrAns;      // link adr adapt answer pending
     bit_t       devsAns;      // device status answer pending
     u1_t        adrEnabled;
@@ -260,6 +272,32 @@ struct lmic_t {
 //! The state of LMIC MAC layer is encapsulated in this variable.
 DECLARE_LMIC; //!< \internal
 
+#if defined(LMIC_MULTI_INSTANCE)
+//! \internal State of the radio driver (radio.c) for one radio.
+struct radio_t {
+    u1_t        randbuf[RADIO_RAND_SEED_SIZE];
+    bit_t       txprep;
+#if !defined(DISABLE_RADIO_SHADOW)
+    u1_t        shadow[0x5B];           // up to RegPaDac
+    u1_t        shadowValid[(0x5B+7)/8];
+    u1_t        shadowOpMode;
+    bit_t       shadowOpModeValid;
+#endif
+};
+
+//! All state of one LMIC stack, the stack works on the one LMIC_CTX
+//! points to (see oslmic.h). Zero it before os_init().
+struct lmic_ctx_t {
+    struct lmic_t   lmic;
+    struct oslmic_t os;
+    struct radio_t  radio;
+    u4_t            aeskey[AESKEY_SIZE/sizeof(u4_t)];
+    u4_t            aesaux[16/sizeof(u4_t)];
+    bit_t           dio[3];     // DIO levels last seen by the Arduino HAL
+    void*           user;       // free for the application, e.g. the node it simulates
+};
+#endif
+
 //! Construct a bit map of allowed datarates from drlo to drhi (both included).
 #define DR_RANGE_MAP(drlo,drhi) (((u2_t)0xFFFF<<(drlo)) & ((u2_t)0xFFFF>>(15-(drhi))))
 #if defined(CFG_eu868)
@@ -288,6 +326,7 @@ void  LMIC_clrTxData    (void);
 void  LMIC_setTxData    (void);
 int   LMIC_setTxData2   (u1_t port, xref2u1_t data, u1_t dlen, u1_t confirmed);
 void  LMIC_sendAlive    (void);
+void  LMIC_requestLinkCheck (void);
 
 #if !defined(DISABLE_BEACONS)
 bit_t LMIC_enableTracking  (u1_t tryBcnInfo);
@@ -306,6 +345,21 @@ void LMIC_setSession (u4_t netid, devaddr_t devaddr, xref2u1_t nwkKey, xref2u1_t
 void LMIC_setLinkCheckMode (bit_t enabled);
 void LMIC_setClockError(u2_t error);
 
+// Session state as saved by LMIC_saveSession(): keys, frame counters,
+// channels, duty cycle and MAC settings and the clock calibration.
+enum { LMIC_SESSION_VERSION = 1 };
+enum { LMIC_SESSION_SIZE = 1+4+4+16+16+4+4      // version, netid, devaddr, keys, seqnos
+#if defined(CFG_eu868)
+                           + 2+1+7*MAX_CHANNELS  // channelMap, channels
+                           + 8*MAX_BANDS         // bands
+#elif defined(CFG_us915)
+                           + 2*((72+MAX_XCHANNELS+15)/16) + 6*MAX_XCHANNELS
+#endif
+                           + 21                  // scheduling, datarate, RX2 and MAC answers
+                           + 7 };                // clock calibration
+u1_t  LMIC_saveSession    (xref2u1_t buf);
+bit_t LMIC_restoreSession (xref2cu1_t buf, u1_t len, ostime_t elapsed);
+
 // Declare onEvent() function, to make sure any definition will have the
 // C conventions, even when in a C++ file.
 DECL_ON_LMIC_EVENT;
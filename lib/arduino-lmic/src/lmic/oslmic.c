@@ -13,10 +13,11 @@
 #include <stdbool.h>
 
 // RUNTIME STATE
-static struct {
-    osjob_t* scheduledjobs;
-    osjob_t* runnablejobs;
-} OS;
+#if defined(LMIC_MULTI_INSTANCE)
+#define OS (LMIC_CTX->os)
+#else
+static struct oslmic_t OS;
+#endif
 
 void os_init () {
     memset(&OS, 0x00, sizeof(OS));
@@ -25,6 +26,14 @@ void os_init () {
     LMIC_init();
 }
 
+// os_init() for a radio that kept its state, see radio_initWarm()
+void os_initWarm (xref2cu1_t seed) {
+    memset(&OS, 0x00, sizeof(OS));
+    hal_init();
+    radio_initWarm(seed);
+    LMIC_init();
+}
+
 ostime_t os_getTime () {
     return hal_ticks();
 }
@@ -93,6 +102,19 @@ void os_setTimedCallback (osjob_t* job, ostime_t time, osjobcb_t cb) {
     #endif
 }
 
+// job os_runloop_once() runs next and its deadline, a runnable job is
+// due now. NULL when nothing is queued.
+osjob_t* os_getNextJob (ostime_t* deadline) {
+    hal_disableIRQs();
+    osjob_t* j = OS.runnablejobs;
+    if(j)
+        *deadline = os_getTime();
+    else if((j = OS.scheduledjobs) != NULL)
+        *deadline = j->deadline;
+    hal_enableIRQs();
+    return j;
+}
+
 // execute jobs from timer and from run queue
 void os_runloop () {
     while(1) {
@@ -69,8 +69,31 @@ typedef              u1_t* xref2u1_t;
 #define ON_LMIC_EVENT(ev)  onEvent(ev)
 #define DECL_ON_LMIC_EVENT void onEvent(ev_t e)
 
+#if defined(USE_ORIGINAL_AES)
+#define AESKEY_SIZE (11*16) // the round keys are expanded in place
+#else
+#define AESKEY_SIZE 16
+#endif
+
+#if defined(LMIC_MULTI_INSTANCE)
+// Several LMIC stacks in one process, e.g. to simulate a fleet of nodes.
+// LMIC, the job queues, the radio driver state and AESKEY/AESAUX of a
+// stack live in a lmic_ctx_t (lmic.h), and the stack works on the one
+// LMIC_CTX points to. Switch it before calling into a stack, including
+// os_runloop_once(). It starts out at a built-in context, so code made
+// for a single stack runs unchanged.
+typedef struct lmic_ctx_t lmic_ctx_t;
+#define DEFINE_LMIC  static lmic_ctx_t lmic_ctx0; lmic_ctx_t* LMIC_CTX = &lmic_ctx0
+#define DECLARE_LMIC extern lmic_ctx_t* LMIC_CTX
+#define LMIC   (LMIC_CTX->lmic)
+#define AESAUX (LMIC_CTX->aesaux)
+#define AESKEY (LMIC_CTX->aeskey)
+#else
 extern u4_t AESAUX[];
 extern u4_t AESKEY[];
+#define DEFINE_LMIC  struct lmic_t LMIC
+#define DECLARE_LMIC extern struct lmic_t LMIC
+#endif
 #define AESkey ((u1_t*)AESKEY)
 #define AESaux ((u1_t*)AESAUX)
 #define FUNC_ADDR(func) (&(func))
@@ -78,12 +101,13 @@ extern u4_t AESKEY[];
 u1_t radio_rand1 (void);
 #define os_getRndU1() radio_rand1()
 
-#define DEFINE_LMIC  struct lmic_t LMIC
-#define DECLARE_LMIC extern struct lmic_t LMIC
-
+enum { RADIO_RAND_SEED_SIZE = 16 };
 void radio_init (void);
+void radio_initWarm (xref2cu1_t seed);
+void radio_getRandSeed (xref2u1_t seed);
 void radio_irq_handler (u1_t dio);
 void os_init (void);
+void os_initWarm (xref2cu1_t seed);
 void os_runloop (void);
 void os_runloop_once (void);
 
@@ -128,6 +152,12 @@ struct osjob_t {
 };
 TYPEDEF_xref2osjob_t;
 
+// Job queues of os_runloop_once()
+struct oslmic_t {
+    osjob_t* scheduledjobs;
+    osjob_t* runnablejobs;
+};
+
 
 #ifndef HAS_os_calls
 
@@ -149,6 +179,9 @@ void os_setTimedCallback (xref2osjob_t job, ostime_t time, osjobcb_t cb);
 #ifndef os_clearCallback
 void os_clearCallback (xref2osjob_t job);
 #endif
+#ifndef os_getNextJob
+xref2osjob_t os_getNextJob (ostime_t* deadline);
+#endif
 #ifndef os_getTime
 ostime_t os_getTime (void);
 #endif
@@ -220,6 +253,7 @@ u2_t os_crc16 (xref2u1_t d, uint len);
 #define TABLE_GET_S4(table, index) table_get_s4(RESOLVE_TABLE(table), index)
 #define TABLE_GET_OSTIME(table, index) table_get_ostime(RESOLVE_TABLE(table), index)
 #define TABLE_GET_U1_TWODIM(table, index1, index2) table_get_u1(RESOLVE_TABLE(table)[index1], index2)
+#define TABLE_GET_OSTIME_TWODIM(table, index1, index2) table_get_ostime(RESOLVE_TABLE(table)[index1], index2)
 
 #if defined(__AVR__)
     #include <avr/pgmspace.h>
@@ -280,6 +314,12 @@ extern xref2u1_t AESaux;
 #ifndef os_aes
 u4_t os_aes (u1_t mode, xref2u1_t buf, u2_t len);
 #endif
+#if !defined(os_aes_ctrmic) && !defined(USE_ORIGINAL_AES)
+// Encrypt buf[off..len) in place with AES-CTR (key ctrkey, counter block
+// ctr) and return the MIC over AESaux+buf[0..len) using AESkey, in a
+// single pass over buf.
+u4_t os_aes_ctrmic (xref2cu1_t ctrkey, xref2u1_t ctr, xref2u1_t buf, u2_t off, u2_t len);
+#endif
 
 #ifdef __cplusplus
 } // extern "C"
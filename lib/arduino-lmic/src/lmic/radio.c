@@ -247,8 +247,13 @@
 
 
 // RADIO STATE
-// (initialized by radio_init(), used by radio_rand1())
-static u1_t randbuf[16];
+// (initialized by radio_init() or radio_initWarm(), used by radio_rand1())
+// With LMIC_MULTI_INSTANCE it is part of the context, see struct radio_t.
+#if defined(LMIC_MULTI_INSTANCE)
+#define randbuf (LMIC_CTX->radio.randbuf)
+#else
+static u1_t randbuf[RADIO_RAND_SEED_SIZE];
+#endif
 
 
 #ifdef CFG_sx1276_radio
@@ -260,14 +265,49 @@ static u1_t randbuf[16];
 #endif
 
 
-static void writeReg (u1_t addr, u1_t data ) {
-    hal_pin_nss(0);
-    hal_spi(addr | 0x80);
-    hal_spi(data);
-    hal_pin_nss(1);
+#if !defined(DISABLE_RADIO_SHADOW)
+// Write-through shadow of the radio configuration registers. In LoRa
+// mode these only change when we write them (their contents are kept in
+// sleep mode), so rewriting an unchanged value is skipped and reads are
+// served from RAM. FIFO, IRQ flags and status registers always go to
+// the chip. The shadow is dropped on reset and when changing modems.
+#define SHADOW_SIZE (RegPaDac+1)
+#if defined(LMIC_MULTI_INSTANCE)
+typedef int check_shadow_size[(sizeof(LMIC_CTX->radio.shadow) == SHADOW_SIZE) ? 1 : -1];
+#define shadow            (LMIC_CTX->radio.shadow)
+#define shadowValid       (LMIC_CTX->radio.shadowValid)
+#define shadowOpMode      (LMIC_CTX->radio.shadowOpMode)
+#define shadowOpModeValid (LMIC_CTX->radio.shadowOpModeValid)
+#else
+static u1_t shadow[SHADOW_SIZE];
+static u1_t shadowValid[(SHADOW_SIZE+7)/8];
+static u1_t shadowOpMode;   // last value written to RegOpMode
+static bit_t shadowOpModeValid;
+#endif
+
+static bit_t isShadowed (u1_t addr) {
+    switch( addr ) {
+      case RegFrfMsb: case RegFrfMid: case RegFrfLsb:
+      case RegPaConfig: case RegPaRamp:
+      case LORARegFifoTxBaseAddr: case LORARegFifoRxBaseAddr:
+      case LORARegIrqFlagsMask:
+      case LORARegModemConfig1: case LORARegModemConfig2: case LORARegModemConfig3:
+      case LORARegSymbTimeoutLsb: case LORARegPayloadMaxLength:
+      case LORARegInvertIQ: case LORARegSyncWord:
+      case RegDioMapping1: case RegDioMapping2:
+      case RegPaDac:
+        return shadowOpModeValid && (shadowOpMode & OPMODE_LORA) != 0;
+    }
+    return 0;
 }
 
-static u1_t readReg (u1_t addr) {
+static void shadowReset () {
+    os_clearMem(shadowValid, sizeof(shadowValid));
+    shadowOpModeValid = 0;
+}
+#endif // !DISABLE_RADIO_SHADOW
+
+static u1_t readRegChip (u1_t addr) {
     hal_pin_nss(0);
     hal_spi(addr & 0x7F);
     u1_t val = hal_spi(0x00);
@@ -275,26 +315,67 @@ static u1_t readReg (u1_t addr) {
     return val;
 }
 
-static void writeBuf (u1_t addr, xref2u1_t buf, u1_t len) {
+static void writeReg (u1_t addr, u1_t data ) {
+#if !defined(DISABLE_RADIO_SHADOW)
+    if( addr == RegOpMode ) {
+        // Changing modems switches to another register page
+        if( !shadowOpModeValid || ((shadowOpMode ^ data) & OPMODE_LORA) != 0 )
+            os_clearMem(shadowValid, sizeof(shadowValid));
+        shadowOpMode = data;
+        shadowOpModeValid = 1;
+    } else if( isShadowed(addr) ) {
+        if( (shadowValid[addr>>3] & (1<<(addr&7))) != 0 && shadow[addr] == data ) {
+#if defined(CHECK_RADIO_SHADOW)
+            ASSERT(readRegChip(addr) == data);
+#endif
+            return;
+        }
+        shadow[addr] = data;
+        shadowValid[addr>>3] |= 1<<(addr&7);
+    }
+#endif // !DISABLE_RADIO_SHADOW
     hal_pin_nss(0);
     hal_spi(addr | 0x80);
-    for (u1_t i=0; i<len; i++) {
-        hal_spi(buf[i]);
-    }
+    hal_spi(data);
     hal_pin_nss(1);
 }
 
-static void readBuf (u1_t addr, xref2u1_t buf, u1_t len) {
-    hal_pin_nss(0);
-    hal_spi(addr & 0x7F);
-    for (u1_t i=0; i<len; i++) {
-        buf[i] = hal_spi(0x00);
+static u1_t readReg (u1_t addr) {
+#if !defined(DISABLE_RADIO_SHADOW)
+    if( isShadowed(addr) && (shadowValid[addr>>3] & (1<<(addr&7))) != 0 ) {
+#if defined(CHECK_RADIO_SHADOW)
+        ASSERT(readRegChip(addr) == shadow[addr]);
+#endif
+        return shadow[addr];
     }
-    hal_pin_nss(1);
+#endif // !DISABLE_RADIO_SHADOW
+    return readRegChip(addr);
+}
+
+// Read RegOpMode as last written. The mode bits are those we selected,
+// the radio may already have left TX/RX on its own.
+static u1_t readOpMode () {
+#if !defined(DISABLE_RADIO_SHADOW)
+    if( shadowOpModeValid ) {
+#if defined(CHECK_RADIO_SHADOW)
+        ASSERT(((readRegChip(RegOpMode) ^ shadowOpMode) & ~OPMODE_MASK) == 0);
+#endif
+        return shadowOpMode;
+    }
+#endif // !DISABLE_RADIO_SHADOW
+    return readRegChip(RegOpMode);
+}
+
+static void writeBuf (u1_t addr, xref2u1_t buf, u1_t len) {
+    hal_spi_burst(addr | 0x80, buf, len, HAL_SPI_WRITE);
+}
+
+static void readBuf (u1_t addr, xref2u1_t buf, u1_t len) {
+    hal_spi_burst(addr & 0x7F, buf, len, HAL_SPI_READ);
 }
 
 static void opmode (u1_t mode) {
-    writeReg(RegOpMode, (readReg(RegOpMode) & ~OPMODE_MASK) | mode);
+    writeReg(RegOpMode, (readOpMode() & ~OPMODE_MASK) | mode);
 }
 
 static void opmodeLora() {
@@ -398,15 +479,15 @@ static void configChannel () {
 
 static void configPower () {
 #ifdef CFG_sx1276_radio
-    // no boost used for now
+    // no boost used for now, PA_BOOST gives 2-17 dBm
     s1_t pw = (s1_t)LMIC.txpow;
-    if(pw >= 17) {
-        pw = 15;
+    if(pw > 17) {
+        pw = 17;
     } else if(pw < 2) {
         pw = 2;
     }
     // check board type for BOOST pin
-    writeReg(RegPaConfig, (u1_t)(0x80|(pw&0xf)));
+    writeReg(RegPaConfig, (u1_t)(0x80|(pw-2)));
     writeReg(RegPaDac, readReg(RegPaDac)|0x4);
 
 #elif CFG_sx1272_radio
@@ -466,21 +547,26 @@ static void txfsk () {
     opmode(OPMODE_TX);
 }
 
-static void txlora () {
+#if defined(LMIC_MULTI_INSTANCE)
+#define txprep (LMIC_CTX->radio.txprep)
+#else
+static bit_t txprep; // LoRa TX settings already loaded by pretxlora()
+#endif
+
+// wake up radio and load the LoRa TX settings that depend on neither
+// the frame nor the channel (rps=LMIC.rps)
+static void pretxlora () {
     // select LoRa modem (from sleep mode)
     //writeReg(RegOpMode, OPMODE_LORA);
     opmodeLora();
-    ASSERT((readReg(RegOpMode) & OPMODE_LORA) != 0);
+    ASSERT((readOpMode() & OPMODE_LORA) != 0);
 
     // enter standby mode (required for FIFO loading))
     opmode(OPMODE_STANDBY);
     // configure LoRa modem (cfg1, cfg2)
     configLoraModem();
-    // configure frequency
-    configChannel();
-    // configure output power
-    writeReg(RegPaRamp, (readReg(RegPaRamp) & 0xF0) | 0x08); // set PA ramp-up time 50 uSec
-    configPower();
+    // set PA ramp-up time 50 uSec
+    writeReg(RegPaRamp, (readReg(RegPaRamp) & 0xF0) | 0x08);
     // set sync word
     writeReg(LORARegSyncWord, LORA_MAC_PREAMBLE);
 
@@ -491,8 +577,21 @@ static void txlora () {
     // mask all IRQs but TxDone
     writeReg(LORARegIrqFlagsMask, ~IRQ_LORA_TXDONE_MASK);
 
-    // initialize the payload size and address pointers
+    // initialize the FIFO base address
     writeReg(LORARegFifoTxBaseAddr, 0x00);
+    txprep = 1;
+}
+
+static void txlora () {
+    if( !txprep )
+        pretxlora();
+    txprep = 0;
+    // configure frequency
+    configChannel();
+    // configure output power
+    configPower();
+
+    // initialize the payload size and address pointers
     writeReg(LORARegFifoAddrPtr, 0x00);
     writeReg(LORARegPayloadLength, LMIC.dataLen);
 
@@ -518,9 +617,18 @@ static void txlora () {
 #endif
 }
 
+// prepare transmitter while the MAC is still building the frame
+// (rps=LMIC.rps), the crystal starts up in the meantime
+static void preparetx () {
+    ASSERT( (readOpMode() & OPMODE_MASK) == OPMODE_SLEEP );
+    if(getSf(LMIC.rps) != FSK) { // FSK is all done in txfsk()
+        pretxlora();
+    }
+}
+
 // start transmitter (buf=LMIC.frame, len=LMIC.dataLen)
 static void starttx () {
-    ASSERT( (readReg(RegOpMode) & OPMODE_MASK) == OPMODE_SLEEP );
+    ASSERT( (readOpMode() & OPMODE_MASK) == (txprep ? OPMODE_STANDBY : OPMODE_SLEEP) );
     if(getSf(LMIC.rps) == FSK) { // FSK modem
         txfsk();
     } else { // LoRa modem
@@ -542,7 +650,7 @@ static CONST_TABLE(u1_t, rxlorairqmask)[] = {
 static void rxlora (u1_t rxmode) {
     // select LoRa modem (from sleep mode)
     opmodeLora();
-    ASSERT((readReg(RegOpMode) & OPMODE_LORA) != 0);
+    ASSERT((readOpMode() & OPMODE_LORA) != 0);
     // enter standby mode (warm up))
     opmode(OPMODE_STANDBY);
     // don't use MAC settings at startup
@@ -657,7 +765,7 @@ static void rxfsk (u1_t rxmode) {
 }
 
 static void startrx (u1_t rxmode) {
-    ASSERT( (readReg(RegOpMode) & OPMODE_MASK) == OPMODE_SLEEP );
+    ASSERT( (readOpMode() & OPMODE_MASK) == OPMODE_SLEEP );
     if(getSf(LMIC.rps) == FSK) { // FSK modem
         rxfsk(rxmode);
     } else { // LoRa modem
@@ -667,9 +775,30 @@ static void startrx (u1_t rxmode) {
     // or timed out, and the corresponding IRQ will inform us about completion.
 }
 
+// forget what is known about the radio registers and put it to sleep
+static void radio_sleepInit () {
+#if !defined(DISABLE_RADIO_SHADOW)
+    shadowReset();
+#endif
+    txprep = 0;
+
+    opmode(OPMODE_SLEEP);
+
+    // some sanity checks, e.g., read version number
+    u1_t v = readReg(RegVersion);
+#ifdef CFG_sx1276_radio
+    ASSERT(v == 0x12 );
+#elif CFG_sx1272_radio
+    ASSERT(v == 0x22);
+#else
+#error Missing CFG_sx1272_radio/CFG_sx1276_radio
+#endif
+}
+
 // get random seed from wideband noise rssi
 void radio_init () {
     hal_disableIRQs();
+    hal_spi_begin();
 
     // manually reset radio
 #ifdef CFG_sx1276_radio
@@ -680,18 +809,8 @@ void radio_init () {
     hal_waitUntil(os_getTime()+ms2osticks(1)); // wait >100us
     hal_pin_rst(2); // configure RST pin floating!
     hal_waitUntil(os_getTime()+ms2osticks(5)); // wait 5ms
+    radio_sleepInit();
 
-    opmode(OPMODE_SLEEP);
-
-    // some sanity checks, e.g., read version number
-    u1_t v = readReg(RegVersion);
-#ifdef CFG_sx1276_radio
-    ASSERT(v == 0x12 );
-#elif CFG_sx1272_radio
-    ASSERT(v == 0x22);
-#else
-#error Missing CFG_sx1272_radio/CFG_sx1276_radio
-#endif
     // seed 15-byte randomness via noise rssi
     rxlora(RXMODE_RSSI);
     while( (readReg(RegOpMode) & OPMODE_MASK) != OPMODE_RX ); // continuous rx
@@ -725,9 +844,32 @@ void radio_init () {
 
     opmode(OPMODE_SLEEP);
 
+    hal_spi_end();
+    hal_enableIRQs();
+}
+
+// Warm start: the MCU lost its RAM, but the radio stayed powered in sleep
+// mode (MCU standby) and kept its configuration and image calibration.
+// Skip the reset and continue the random sequence from the seed saved
+// with radio_getRandSeed() instead of sampling noise for seconds.
+void radio_initWarm (xref2cu1_t seed) {
+    hal_disableIRQs();
+    hal_spi_begin();
+
+    os_copyMem(randbuf, seed, sizeof(randbuf));
+    if( randbuf[0] == 0 || randbuf[0] > 16 )
+        randbuf[0] = 16; // stir before first use
+    radio_sleepInit();
+
+    hal_spi_end();
     hal_enableIRQs();
 }
 
+// copy the state of the random generator for radio_initWarm()
+void radio_getRandSeed (xref2u1_t seed) {
+    os_copyMem(seed, randbuf, sizeof(randbuf));
+}
+
 // return next random byte derived from seed buffer
 // (buf[0] holds index of next byte to be returned)
 u1_t radio_rand1 () {
@@ -763,7 +905,8 @@ static CONST_TABLE(u2_t, LORA_RXDONE_FIXUP)[] = {
 // (radio goes to stanby mode after tx/rx operations)
 void radio_irq_handler (u1_t dio) {
     ostime_t now = os_getTime();
-    if( (readReg(RegOpMode) & OPMODE_LORA) != 0) { // LORA modem
+    hal_spi_begin();
+    if( (readOpMode() & OPMODE_LORA) != 0) { // LORA modem
         u1_t flags = readReg(LORARegIrqFlags);
 #if LMIC_DEBUG_LEVEL > 1
         lmic_printf("%lu: irq: dio: 0x%x flags: 0x%x\n", now, dio, flags);
@@ -820,16 +963,24 @@ void radio_irq_handler (u1_t dio) {
     }
     // go from standby to sleep
     opmode(OPMODE_SLEEP);
+    hal_spi_end();
     // run os job (use preset func ptr)
     os_setCallback(&LMIC.osjob, LMIC.osjob.func);
 }
 
 void os_radio (u1_t mode) {
     hal_disableIRQs();
+    hal_spi_begin();
     switch (mode) {
       case RADIO_RST:
         // put radio to sleep
         opmode(OPMODE_SLEEP);
+        txprep = 0;
+        break;
+
+      case RADIO_TXPREP:
+        // wake up radio and load settings for the next transmission
+        preparetx(); // rps=LMIC.rps
         break;
 
       case RADIO_TX:
@@ -847,5 +998,6 @@ void os_radio (u1_t mode) {
         startrx(RXMODE_SCAN); // buf=LMIC.frame
         break;
     }
+    hal_spi_end();
     hal_enableIRQs();
 }
@@ -0,0 +1,172 @@
+#include <lmic.h>
+#include <hal/hal.h>
+#include <chrono>
+#include <stdio.h>
+#include "unity.h"
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = 1,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+#if defined(USE_ORIGINAL_AES)
+#define BACKEND "original"
+#elif defined(USE_IDEETRON_AES)
+#define BACKEND "ideetron"
+#elif defined(USE_M0PLUS_AES)
+#define BACKEND "m0plus"
+#endif
+
+#if !defined(USE_ORIGINAL_AES)
+// Block functions offered to aes/other.c by the other backends
+extern "C" void lmic_aes_encrypt(u1_t *data, u1_t *key);
+extern "C" void lmic_aes_expandKey(const u1_t *key, u1_t *sched);
+extern "C" void lmic_aes_encryptSched(u1_t *data, const u1_t *sched);
+#endif
+
+// FIPS-197 appendix C.1
+static const u1_t key[16] = {
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+  0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+static const u1_t plain[16] = {
+  0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+  0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+};
+static const u1_t cipher[16] = {
+  0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+  0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a,
+};
+// FIPS-197 appendix A.1, round key 10 (w[40..43])
+static const u1_t key_a1[16] = {
+  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+  0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+static const u1_t round10_a1[16] = {
+  0xd0, 0x14, 0xf9, 0xa8, 0xc9, 0xee, 0x25, 0x89,
+  0xe1, 0x3f, 0x0c, 0xc8, 0xb6, 0x63, 0x0c, 0xa6,
+};
+
+#define BENCH_BLOCKS 20000
+
+#if !defined(USE_ORIGINAL_AES)
+// word aligned, as the m0plus backend stores the schedule as words
+static u4_t sched_words[176 / 4];
+#define sched ((u1_t *)sched_words)
+#endif
+
+static double ns_per_block(std::chrono::steady_clock::time_point start)
+{
+  std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+  return d.count() / BENCH_BLOCKS;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#if !defined(USE_ORIGINAL_AES)
+void test_encrypt(void)
+{
+  u1_t k[16], buf[16];
+  memcpy(k, key, 16);
+  memcpy(buf, plain, 16);
+  lmic_aes_encrypt(buf, k);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(cipher, buf, 16);
+  // the key is left alone
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(key, k, 16);
+}
+
+void test_expand_key(void)
+{
+  lmic_aes_expandKey(key_a1, sched);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(key_a1, sched, 16);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(round10_a1, sched + 160, 16);
+}
+
+void test_encrypt_sched(void)
+{
+  u1_t buf[16];
+  memcpy(buf, plain, 16);
+  lmic_aes_expandKey(key, sched);
+  lmic_aes_encryptSched(buf, sched);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(cipher, buf, 16);
+}
+
+#endif
+
+void test_os_aes_enc(void)
+{
+  // os_aes goes through whichever mode config.h selected
+  u1_t buf[32];
+  memcpy(buf, plain, 16);
+  memcpy(buf + 16, plain, 16);
+  memcpy(AESkey, key, 16);
+  os_aes(AES_ENC, buf, 32);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(cipher, buf, 16);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(cipher, buf + 16, 16);
+}
+
+void test_bench(void)
+{
+  u1_t buf[16 * 4];
+  char msg[128];
+  memset(buf, 0, sizeof(buf));
+
+  // os_aes() as LMIC uses it, four blocks per call like a typical frame
+  memcpy(AESkey, key, 16);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_BLOCKS; i += 4)
+    os_aes(AES_ENC, buf, sizeof(buf));
+  double os_ns = ns_per_block(start);
+  snprintf(msg, sizeof(msg), BACKEND ": os_aes %.1f ns/block", os_ns);
+  TEST_MESSAGE(msg);
+
+#if !defined(USE_ORIGINAL_AES)
+  u1_t k[16];
+  memcpy(k, key, 16);
+  memcpy(buf, plain, 16);
+
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_BLOCKS; i++)
+    lmic_aes_encrypt(buf, k);
+  double plain_ns = ns_per_block(start);
+
+  u1_t check[16];
+  memcpy(check, buf, 16);
+  memcpy(buf, plain, 16);
+
+  start = std::chrono::steady_clock::now();
+  lmic_aes_expandKey(k, sched);
+  for (int i = 0; i < BENCH_BLOCKS; i++)
+    lmic_aes_encryptSched(buf, sched);
+  double sched_ns = ns_per_block(start);
+
+  // both chains of encryptions end up in the same place
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(check, buf, 16);
+
+  snprintf(msg, sizeof(msg), BACKEND ": round keys per block %.1f ns/block, key schedule %.1f ns/block",
+           plain_ns, sched_ns);
+  TEST_MESSAGE(msg);
+#endif
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+#if !defined(USE_ORIGINAL_AES)
+  RUN_TEST(test_encrypt);
+  RUN_TEST(test_expand_key);
+  RUN_TEST(test_encrypt_sched);
+#endif
+  RUN_TEST(test_os_aes_enc);
+  RUN_TEST(test_bench);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
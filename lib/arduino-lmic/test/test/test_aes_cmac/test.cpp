@@ -0,0 +1,101 @@
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = 1,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// RFC 4493 section 4 test vectors
+static const u1_t key[16] = {
+  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+  0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+static const u1_t msg[64] = {
+  0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+  0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+  0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+  0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+static const u1_t mac16[16] = {
+  0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c,
+};
+static const u1_t mac40[16] = {
+  0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27,
+};
+static const u1_t mac64[16] = {
+  0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe,
+};
+
+static u1_t buf[80];
+
+// CMAC over the first len bytes of msg, MIC returned, full tag in AESaux
+static u4_t cmac(const u1_t *k, u2_t len)
+{
+  memcpy(AESkey, k, 16);
+  memcpy(buf, msg, len);
+  return os_aes(AES_MIC | AES_MICNOAUX, buf, len);
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_cmac_full_block(void)
+{
+  TEST_ASSERT_EQUAL_HEX32(os_rmsbf4(mac16), cmac(key, 16));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(mac16, AESaux, 16);
+}
+
+void test_cmac_partial_block(void)
+{
+  cmac(key, 40);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(mac40, AESaux, 16);
+}
+
+void test_cmac_four_blocks(void)
+{
+  cmac(key, 64);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(mac64, AESaux, 16);
+}
+
+void test_cmac_key_change(void)
+{
+  u1_t other[16];
+  memset(other, 0x55, sizeof(other));
+  cmac(key, 40);
+  u4_t first = cmac(other, 40);
+  cmac(key, 40);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(mac40, AESaux, 16);
+  // and back to the other key gives the same result as before
+  TEST_ASSERT_EQUAL_HEX32(first, cmac(other, 40));
+}
+
+void test_cmac_with_aux_block(void)
+{
+  // Prepending AESaux (the LoRaWAN B0 block) is CMAC over aux || msg
+  memcpy(AESkey, key, 16);
+  memcpy(AESaux, msg, 16);
+  memcpy(buf, msg + 16, 24);
+  os_aes(AES_MIC, buf, 24);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(mac40, AESaux, 16);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_cmac_full_block);
+  RUN_TEST(test_cmac_partial_block);
+  RUN_TEST(test_cmac_four_blocks);
+  RUN_TEST(test_cmac_key_change);
+  RUN_TEST(test_cmac_with_aux_block);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,131 @@
+#include <lmic.h>
+#include <hal/hal.h>
+#include <stdlib.h>
+#include "unity.h"
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = 1,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+static u1_t nwkKey[16];
+static u1_t artKey[16];
+
+// Counter block A1 and MIC block B0 as lmic.c builds them for uplinks
+static void ctrBlock(u1_t *blk, u4_t devaddr, u4_t seqno)
+{
+  memset(blk, 0, 16);
+  blk[0] = blk[15] = 1;
+  os_wlsbf4(blk + 6, devaddr);
+  os_wlsbf4(blk + 10, seqno);
+}
+
+static void micBlock(u1_t *blk, u4_t devaddr, u4_t seqno, u1_t len)
+{
+  memset(blk, 0, 16);
+  blk[0] = 0x49;
+  blk[15] = len;
+  os_wlsbf4(blk + 6, devaddr);
+  os_wlsbf4(blk + 10, seqno);
+}
+
+// The separate path: os_aes(AES_CTR) over the payload, then
+// os_aes(AES_MIC) over the frame
+static u4_t separate(const u1_t *ctrkey, u1_t *frame, u1_t off, u1_t len, u4_t devaddr, u4_t seqno)
+{
+  ctrBlock(AESaux, devaddr, seqno);
+  memcpy(AESkey, ctrkey, 16);
+  if (len > off)
+    os_aes(AES_CTR, frame + off, len - off);
+  micBlock(AESaux, devaddr, seqno, len);
+  memcpy(AESkey, nwkKey, 16);
+  return os_aes(AES_MIC, frame, len);
+}
+
+static u4_t fused(const u1_t *ctrkey, u1_t *frame, u1_t off, u1_t len, u4_t devaddr, u4_t seqno)
+{
+  u1_t ctr[16];
+  ctrBlock(ctr, devaddr, seqno);
+  micBlock(AESaux, devaddr, seqno, len);
+  memcpy(AESkey, nwkKey, 16);
+  return os_aes_ctrmic(ctrkey, ctr, frame, off, len);
+}
+
+static void check(const u1_t *ctrkey, u1_t off, u1_t len)
+{
+  u1_t a[MAX_LEN_FRAME], b[MAX_LEN_FRAME];
+  u4_t devaddr = rand(), seqno = rand() & 0xFFFF;
+  for (u1_t i = 0; i < len; i++)
+    a[i] = b[i] = rand();
+
+  u4_t mica = separate(ctrkey, a, off, len, devaddr, seqno);
+  u4_t micb = fused(ctrkey, b, off, len, devaddr, seqno);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(a, b, len);
+  TEST_ASSERT_EQUAL_HEX32(mica, micb);
+}
+
+void setUp(void)
+{
+  srand(1);
+  for (u1_t i = 0; i < 16; i++) {
+    nwkKey[i] = rand();
+    artKey[i] = rand();
+  }
+}
+
+void tearDown(void) {}
+
+void test_app_payload(void)
+{
+  // FHDR of 8 bytes, FPort, then the payload
+  for (u1_t len = 9; len <= MAX_LEN_FRAME; len++)
+    check(artKey, 9, len);
+}
+
+void test_mac_payload(void)
+{
+  // port 0 encrypts with the network key, the same key as the MIC
+  for (u1_t len = 9; len < 40; len++)
+    check(nwkKey, 9, len);
+}
+
+void test_with_fopts(void)
+{
+  // FOpts push the payload off any block boundary
+  for (u1_t off = 9; off < 25; off++)
+    check(artKey, off, off + 33);
+}
+
+void test_empty_payload(void)
+{
+  check(artKey, 9, 9);
+}
+
+void test_key_change(void)
+{
+  // a new session key must not pick up a stale key schedule
+  check(artKey, 9, 40);
+  artKey[3] ^= 0x10;
+  check(artKey, 9, 40);
+  nwkKey[7] ^= 0x01;
+  check(artKey, 9, 40);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_app_payload);
+  RUN_TEST(test_mac_payload);
+  RUN_TEST(test_with_fopts);
+  RUN_TEST(test_empty_payload);
+  RUN_TEST(test_key_change);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,108 @@
+#include <Arduino.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <chrono>
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = 1,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// calcAirTime() as it was before the tables, the reference
+static ostime_t calcAirTimeRef(rps_t rps, u1_t plen)
+{
+  u1_t bw = getBw(rps);
+  u1_t sf = getSf(rps);
+  if (sf == FSK) {
+    return (plen + 5 + 3 + 1 + 2) * 8 * (s4_t)OSTICKS_PER_SEC / 50000;
+  }
+  u1_t sfx = 4 * (sf + (7 - SF7));
+  u1_t q = sfx - (sf >= SF11 ? 8 : 0);
+  int tmp = 8 * plen - sfx + 28 + (getNocrc(rps) ? 0 : 16) - (getIh(rps) ? 20 : 0);
+  if (tmp > 0) {
+    tmp = (tmp + q - 1) / q;
+    tmp *= getCr(rps) + 5;
+    tmp += 8;
+  }
+  else {
+    tmp = 8;
+  }
+  tmp = (tmp << 2) + 49;
+  sfx = sf + (7 - SF7) - (3 + 2) - bw;
+  int div = 15625;
+  if (sfx > 4) {
+    div >>= sfx - 4;
+    sfx = 4;
+  }
+  return (((ostime_t)tmp << sfx) * OSTICKS_PER_SEC + div / 2) / div;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_all_uplink_rates_and_lengths(void)
+{
+  for (dr_t dr = 0; validDR(dr); dr++) {
+    rps_t rps = updr2rps(dr);
+    for (int len = 0; len <= 255; len++)
+      TEST_ASSERT_EQUAL_MESSAGE(calcAirTimeRef(rps, len), calcAirTime(rps, len), "uplink dr/len");
+  }
+}
+
+void test_all_other_rps(void)
+{
+  // downlinks (no CRC), implicit header, other coding rates, all SF/BW
+  for (int sf = FSK; sf <= SF12; sf++)
+    for (int bw = BW125; bw <= BW500; bw++)
+      for (int cr = CR_4_5; cr <= CR_4_8; cr++)
+        for (int nocrc = 0; nocrc <= 1; nocrc++)
+          for (int ih = 0; ih <= 1; ih++) {
+            rps_t rps = MAKERPS(sf, bw, cr, ih ? 20 : 0, nocrc);
+            for (int len = 0; len <= 255; len++)
+              TEST_ASSERT_EQUAL_MESSAGE(calcAirTimeRef(rps, len), calcAirTime(rps, len), "rps/len");
+          }
+}
+
+void test_known_values(void)
+{
+  // 13 byte frame (no payload): SF12 1155.1 ms, SF7 46.3 ms
+  TEST_ASSERT_UINT32_WITHIN(ms2osticks(1), us2osticks(1155072), calcAirTime(updr2rps(DR_SF12), 13));
+  TEST_ASSERT_UINT32_WITHIN(ms2osticks(1), us2osticks(46336), calcAirTime(updr2rps(DR_SF7), 13));
+}
+
+void test_print_timing(void)
+{
+  volatile ostime_t sink = 0;
+  auto time = [&](ostime_t (*fn)(rps_t, u1_t)) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 200; i++)
+      for (dr_t dr = DR_SF12; dr <= DR_SF7; dr++)
+        for (int len = 0; len <= MAX_LEN_FRAME; len++)
+          sink = sink + fn(updr2rps(dr), len);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  };
+  double ref = time(calcAirTimeRef);
+  double tab = time(calcAirTime);
+  int n = 200 * 6 * (MAX_LEN_FRAME + 1);
+  printf("calcAirTime: %.1f ns computed, %.1f ns looked up\n", ref / n, tab / n);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_all_uplink_rates_and_lengths);
+  RUN_TEST(test_all_other_rps);
+  RUN_TEST(test_known_values);
+  RUN_TEST(test_print_timing);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
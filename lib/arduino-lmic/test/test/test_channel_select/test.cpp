@@ -0,0 +1,206 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <stdlib.h>
+
+#define PIN_NSS 1
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = PIN_NSS,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// Just enough of an SX1276 to get through radio_init(): a plain register
+// file with RegVersion and a noisy RssiWideband for the random seed
+static uint8_t regs[0x80];
+static int spiPos;
+static uint8_t spiAddr;
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == PIN_NSS && val == 0)
+    spiPos = 0;
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    regs[addr] = out;
+    return 0;
+  }
+  if (addr == 0x2C) // RegRssiWideband
+    return rand();
+  return regs[addr];
+}
+
+static u1_t nwkKey[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static u1_t artKey[16] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+static u1_t payload[4];
+
+// The channel search of nextTx() as it was before the masks, on a copy of
+// the lastchnl of each band. Returns the channel or -1.
+static int refNextTx(ostime_t now, u1_t *lastchnl, ostime_t *txtime)
+{
+  u1_t bmap = 0xF;
+  do {
+    ostime_t mintime = now + sec2osticks(28800);
+    u1_t band = 0;
+    for (u1_t bi = 0; bi < 4; bi++) {
+      if ((bmap & (1 << bi)) && mintime - LMIC.bands[bi].avail > 0)
+        mintime = LMIC.bands[band = bi].avail;
+    }
+    u1_t chnl = lastchnl[band];
+    for (u1_t ci = 0; ci < MAX_CHANNELS; ci++) {
+      if ((chnl = (chnl + 1)) >= MAX_CHANNELS)
+        chnl -= MAX_CHANNELS;
+      if ((LMIC.channelMap & (1 << chnl)) != 0 && (LMIC.channelDrMap[chnl] & (1 << (LMIC.datarate & 0xF))) != 0 &&
+          band == (LMIC.channelFreq[chnl] & 0x3)) {
+        lastchnl[band] = chnl;
+        *txtime = mintime;
+        return chnl;
+      }
+    }
+    if ((bmap &= ~(1 << band)) == 0)
+      return -1;
+  } while (1);
+}
+
+// Let the engine pick the channel for an uplink, the band avail times are
+// in the future so it only schedules the TX. Returns the channel.
+static u1_t pickChannel(void)
+{
+  LMIC.opmode |= OP_NEXTCHNL;
+  LMIC_setTxData2(1, payload, sizeof(payload), 0);
+  u1_t chnl = LMIC.txChnl;
+  LMIC_clrTxData();
+  return chnl;
+}
+
+static void busyBands(void)
+{
+  for (u1_t b = 0; b < MAX_BANDS; b++)
+    LMIC.bands[b].avail = os_getTime() + sec2osticks(10 + b);
+}
+
+void setUp(void)
+{
+  memset(regs, 0, sizeof(regs));
+  regs[0x42] = 0x12; // RegVersion
+  sim_pin_write = radioPin;
+  sim_spi_transfer = radioSpi;
+  os_init();
+  LMIC_reset();
+  LMIC_setSession(0x13, 0x26011BDA, nwkKey, artKey);
+  LMIC_setAdrMode(0);
+  LMIC.txpow = 14;
+}
+
+void tearDown(void) {}
+
+void test_round_robin(void)
+{
+  // the three default channels share a band and take turns
+  LMIC_setDrTxpow(DR_SF9, 14);
+  busyBands();
+  u1_t first = pickChannel();
+  TEST_ASSERT_LESS_THAN(3, first);
+  TEST_ASSERT_EQUAL((first + 1) % 3, pickChannel());
+  TEST_ASSERT_EQUAL((first + 2) % 3, pickChannel());
+  TEST_ASSERT_EQUAL(first, pickChannel());
+}
+
+void test_dr_limited(void)
+{
+  // an extra channel that only takes SF7, in the band that is free first
+  LMIC_setupChannel(9, 869525000, DR_RANGE_MAP(DR_SF7, DR_SF7), BAND_DECI);
+  busyBands();
+  LMIC.bands[BAND_DECI].avail = os_getTime() + sec2osticks(1);
+
+  LMIC_setDrTxpow(DR_SF7, 14);
+  TEST_ASSERT_EQUAL(9, pickChannel());
+  TEST_ASSERT_EQUAL(LMIC.bands[BAND_DECI].avail, LMIC.txend);
+
+  // not for SF12, then the band of the default channels is next
+  LMIC_setDrTxpow(DR_SF12, 14);
+  TEST_ASSERT_LESS_THAN(3, pickChannel());
+  TEST_ASSERT_EQUAL(LMIC.bands[BAND_CENTI].avail, LMIC.txend);
+
+  // nor when it is disabled again
+  LMIC_setDrTxpow(DR_SF7, 14);
+  LMIC_disableChannel(9);
+  TEST_ASSERT_LESS_THAN(3, pickChannel());
+}
+
+void test_no_channel(void)
+{
+  // no channel allows FSK, the channel is left as it was
+  busyBands();
+  LMIC_setDrTxpow(DR_SF9, 14);
+  u1_t chnl = pickChannel();
+  LMIC_setDrTxpow(DR_FSK, 14);
+  TEST_ASSERT_EQUAL(chnl, pickChannel());
+}
+
+void test_same_as_before(void)
+{
+  srand(1);
+  for (int setup = 0; setup < 50; setup++) {
+    setUp();
+    for (u1_t ch = 3; ch < MAX_CHANNELS; ch++) {
+      if (rand() % 4 == 0)
+        continue;
+      u1_t lo = rand() % 6;
+      u1_t hi = lo + rand() % (8 - lo);
+      LMIC_setupChannel(ch, 863000000 + ch * 200000, DR_RANGE_MAP(lo, hi), rand() % MAX_BANDS);
+    }
+    for (u1_t ch = 0; ch < MAX_CHANNELS; ch++)
+      if (rand() % 5 == 0)
+        LMIC_disableChannel(ch);
+    LMIC.channelMap &= rand() | 1;
+
+    u1_t lastchnl[MAX_BANDS];
+    for (u1_t b = 0; b < MAX_BANDS; b++)
+      lastchnl[b] = LMIC.bands[b].lastchnl = rand() % MAX_CHANNELS;
+
+    for (int i = 0; i < 200; i++) {
+      LMIC_setDrTxpow(rand() % 8, 14);
+      for (u1_t b = 0; b < MAX_BANDS; b++)
+        LMIC.bands[b].avail = os_getTime() + sec2osticks(10) + rand() % 1000;
+      u1_t prev = LMIC.txChnl;
+      ostime_t txtime;
+      int expect = refNextTx(os_getTime(), lastchnl, &txtime);
+      u1_t chnl = pickChannel();
+      if (expect < 0) {
+        TEST_ASSERT_EQUAL(prev, chnl);
+        continue;
+      }
+      TEST_ASSERT_EQUAL(expect, chnl);
+      TEST_ASSERT_EQUAL(txtime, LMIC.txend);
+    }
+  }
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_round_robin);
+  RUN_TEST(test_dr_limited);
+  RUN_TEST(test_no_channel);
+  RUN_TEST(test_same_as_before);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
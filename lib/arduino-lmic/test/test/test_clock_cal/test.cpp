@@ -0,0 +1,300 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <stdlib.h>
+
+#define PIN_NSS 1
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = PIN_NSS,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// Just enough of an SX1276 for a TX and the RX windows: a plain register
+// file with the FIFO behind RegFifo. The test raises the IRQ flags itself.
+static uint8_t regs[0x80];
+static uint8_t fifo[256];
+static int spiPos;
+static uint8_t spiAddr;
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == PIN_NSS && val == 0)
+    spiPos = 0;
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    if (addr == 0x00)
+      fifo[regs[0x0D]++] = out;
+    else
+      regs[addr] = out;
+    return 0;
+  }
+  if (addr == 0x00)
+    return fifo[regs[0x0D]++];
+  if (addr == 0x2C) // RegRssiWideband
+    return rand();
+  return regs[addr];
+}
+
+#define DEVADDR 0x26011BDA
+// 1%, less than the 25% of src/main.cpp so a drift of 2% counts as bogus
+#define CLOCK_ERROR (MAX_CLOCK_ERROR * 1 / 100)
+// CLOCK_ERROR_MIN of lmic.c
+#define CLOCK_ERROR_MIN (MAX_CLOCK_ERROR / 1000)
+
+static u1_t nwkKey[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static u1_t artKey[16] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+static u1_t payload[4] = {1, 2, 3, 4};
+
+// The radio got out of RX/TX and raises DIO with these IRQ flags
+static void radioIrq(uint8_t flags)
+{
+  regs[0x01] = (regs[0x01] & ~0x07) | 0x01; // standby
+  regs[0x12] = flags;
+  radio_irq_handler(0);
+}
+
+// Run the jobs until the radio is in the given mode of RegOpMode
+static void runUntilMode(uint8_t mode)
+{
+  for (int i = 0; i < 100000 && (regs[0x01] & 0x07) != mode; i++)
+    os_runloop_once();
+  TEST_ASSERT_EQUAL(mode, regs[0x01] & 0x07);
+}
+
+// Send an uplink, when the duty cycle allows, and run up to the start of
+// RX1
+static void uplink(void)
+{
+  LMIC_setTxData2(1, payload, sizeof(payload), 0);
+  runUntilMode(0x03); // TX
+  radioIrq(0x08);     // TxDone
+  runUntilMode(0x06); // RXSINGLE
+}
+
+// Nothing in RX1, run up to the start of RX2
+static void missRx1(void)
+{
+  radioIrq(0x80); // RxTimeout
+  runUntilMode(0x06);
+}
+
+// Nothing in RX2 either
+static void missRx2(void)
+{
+  radioIrq(0x80);
+  os_runloop_once();
+}
+
+// An empty downlink in RX1 that started offset ticks after the start
+// expected for a perfect clock
+static void downlink(ostime_t offset)
+{
+  u1_t *d = fifo;
+  int len = OFF_DAT_OPTS;
+  d[OFF_DAT_HDR] = HDR_FTYPE_DADN | HDR_MAJOR_V1;
+  os_wlsbf4(d + OFF_DAT_ADDR, DEVADDR);
+  d[OFF_DAT_FCT] = 0;
+  os_wlsbf2(d + OFF_DAT_SEQNO, LMIC.seqnoDn);
+  // MIC with B0 for the downlink, like aes_appendMic() of lmic.c
+  memset(AESaux, 0, 16);
+  AESaux[0] = 0x49;
+  AESaux[5] = 1;
+  os_wlsbf4(AESaux + 6, DEVADDR);
+  os_wlsbf4(AESaux + 10, LMIC.seqnoDn);
+  AESaux[15] = len;
+  memcpy(AESkey, nwkKey, 16);
+  os_wmsbf4(d + len, os_aes(AES_MIC, d, len));
+  regs[0x0D] = 0;       // RegFifoAddrPtr
+  regs[0x10] = 0;       // RegFifoRxCurrentAddr
+  regs[0x13] = len + 4; // RegRxNbBytes
+  radioIrq(0x40);       // RxDone
+  // the end of the frame as the radio reported it
+  LMIC.rxtime = LMIC.rxexp + calcAirTime(LMIC.rps, LMIC.dataLen) + offset;
+  os_runloop_once();
+}
+
+// Drift sample for an offset in RX1, as calibrateClock() takes it
+static s4_t sample(ostime_t offset)
+{
+  return (int64_t)offset * MAX_CLOCK_ERROR / sec2osticks(LMIC.rxDelay);
+}
+
+void setUp(void)
+{
+  memset(regs, 0, sizeof(regs));
+  regs[0x42] = 0x12; // RegVersion
+  sim_pin_write = radioPin;
+  sim_spi_transfer = radioSpi;
+  os_init();
+  LMIC_reset();
+  LMIC_setSession(0x13, DEVADDR, nwkKey, artKey);
+  LMIC_setAdrMode(0);
+  LMIC_setLinkCheckMode(0);
+  // SF7 has short symbols, so the clock error changes the window length
+  LMIC_setDrTxpow(DR_SF7, 14);
+  // the estimate survives LMIC_reset(), start without one
+  LMIC.clockCalCnt = 0;
+  LMIC.clockDrift = 0;
+  LMIC.clockDev = 0;
+  LMIC_setClockError(CLOCK_ERROR);
+}
+
+void tearDown(void) {}
+
+void test_first_downlink_sets_drift(void)
+{
+  uplink();
+  TEST_ASSERT_EQUAL(LMIC.txend + sec2osticks(LMIC.rxDelay), LMIC.rxexp);
+  downlink(10);
+  TEST_ASSERT_EQUAL(1, LMIC.clockCalCnt);
+  TEST_ASSERT_EQUAL(sample(10), LMIC.clockDrift);
+  // the window starts as wide as configured
+  TEST_ASSERT_EQUAL(CLOCK_ERROR / 4, LMIC.clockDev);
+  // 4 * clockDev + CLOCK_ERROR_MIN is more, clamped to clockErrorMax
+  TEST_ASSERT_EQUAL(CLOCK_ERROR, LMIC.clockError);
+}
+
+void test_downlinks_narrow_the_window(void)
+{
+  for (int i = 0; i < 10; i++) {
+    uplink();
+    downlink(10);
+  }
+  TEST_ASSERT_EQUAL(10, LMIC.clockCalCnt);
+  TEST_ASSERT_EQUAL(sample(10), LMIC.clockDrift);
+  // every sample agreed, the deviation went down by a quarter each time
+  u2_t dev = CLOCK_ERROR / 4;
+  for (int i = 1; i < 10; i++)
+    dev = dev - dev / 4;
+  TEST_ASSERT_EQUAL(dev, LMIC.clockDev);
+  TEST_ASSERT_EQUAL(4 * dev + CLOCK_ERROR_MIN, LMIC.clockError);
+  TEST_ASSERT_LESS_THAN(CLOCK_ERROR, LMIC.clockError);
+}
+
+void test_drift_follows_samples(void)
+{
+  uplink();
+  downlink(10);
+  uplink();
+  downlink(30);
+  // a quarter of the difference
+  s4_t diff = sample(30) - sample(10);
+  TEST_ASSERT_EQUAL(sample(10) + diff / 4, LMIC.clockDrift);
+  TEST_ASSERT_EQUAL(CLOCK_ERROR / 4 + (diff - CLOCK_ERROR / 4) / 4, LMIC.clockDev);
+}
+
+void test_bogus_sample_ignored(void)
+{
+  uplink();
+  // more drift than the configured clock error allows
+  downlink(sec2osticks(LMIC.rxDelay) * 2 / 100);
+  TEST_ASSERT_EQUAL(0, LMIC.clockCalCnt);
+  TEST_ASSERT_EQUAL(0, LMIC.clockDrift);
+  TEST_ASSERT_EQUAL(CLOCK_ERROR, LMIC.clockError);
+}
+
+// Start of RX1 and RX2 after the nominal start, for a drift estimate
+// with the window width fixed at error
+static void rxStarts(u1_t cnt, s4_t drift, u2_t error, ostime_t *rx1, ostime_t *rx2)
+{
+  setUp();
+  LMIC.clockCalCnt = cnt;
+  LMIC.clockDrift = drift;
+  LMIC.clockError = error;
+  uplink();
+  *rx1 = LMIC.rxtime - LMIC.rxexp;
+  missRx1();
+  TEST_ASSERT_EQUAL(LMIC.txend + sec2osticks(LMIC.rxDelay + 1), LMIC.rxexp);
+  *rx2 = LMIC.rxtime - LMIC.rxexp;
+}
+
+void test_drift_shifts_rx_windows(void)
+{
+  ostime_t rx1, rx2, rx1Cal, rx2Cal;
+  rxStarts(0, 0, 1000, &rx1, &rx2);
+  rxStarts(1, 1000, 1000, &rx1Cal, &rx2Cal);
+  // a fast clock (positive drift) opens the windows later, by the drift
+  // over the delay of each window
+  TEST_ASSERT_EQUAL((int64_t)sec2osticks(LMIC.rxDelay) * 1000 / MAX_CLOCK_ERROR, rx1Cal - rx1);
+  TEST_ASSERT_EQUAL((int64_t)sec2osticks(LMIC.rxDelay + 1) * 1000 / MAX_CLOCK_ERROR, rx2Cal - rx2);
+  rxStarts(1, -1000, 1000, &rx1Cal, &rx2Cal);
+  TEST_ASSERT_EQUAL(-(int64_t)sec2osticks(LMIC.rxDelay) * 1000 / MAX_CLOCK_ERROR, rx1Cal - rx1);
+}
+
+void test_narrow_window_opens_less_early(void)
+{
+  ostime_t rx1Wide, rx2Wide, rx1, rx2;
+  rxStarts(1, 0, CLOCK_ERROR, &rx1Wide, &rx2Wide);
+  u1_t symsWide = LMIC.rxsyms;
+  rxStarts(1, 0, CLOCK_ERROR_MIN, &rx1, &rx2);
+  TEST_ASSERT_LESS_THAN(symsWide, LMIC.rxsyms);
+  TEST_ASSERT_GREATER_THAN(rx1Wide, rx1);
+  TEST_ASSERT_GREATER_THAN(rx2Wide, rx2);
+}
+
+void test_missed_windows_open_again(void)
+{
+  for (int i = 0; i < 10; i++) {
+    uplink();
+    downlink(10);
+  }
+  u2_t dev = LMIC.clockDev;
+  // nothing in RX1 and RX2
+  uplink();
+  missRx1();
+  missRx2();
+  TEST_ASSERT_EQUAL(dev + dev / 16 + 1, LMIC.clockDev);
+  TEST_ASSERT_EQUAL(4 * LMIC.clockDev + CLOCK_ERROR_MIN, LMIC.clockError);
+  // the drift estimate is kept
+  TEST_ASSERT_EQUAL(sample(10), LMIC.clockDrift);
+  // and never wider than configured
+  for (int i = 0; i < 100; i++) {
+    uplink();
+    missRx1();
+    missRx2();
+  }
+  TEST_ASSERT_EQUAL(CLOCK_ERROR, LMIC.clockDev);
+  TEST_ASSERT_EQUAL(CLOCK_ERROR, LMIC.clockError);
+}
+
+void test_no_calibration_without_clock_error(void)
+{
+  LMIC_setClockError(0);
+  uplink();
+  downlink(10);
+  TEST_ASSERT_EQUAL(0, LMIC.clockCalCnt);
+  TEST_ASSERT_EQUAL(0, LMIC.clockError);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_first_downlink_sets_drift);
+  RUN_TEST(test_downlinks_narrow_the_window);
+  RUN_TEST(test_drift_follows_samples);
+  RUN_TEST(test_bogus_sample_ignored);
+  RUN_TEST(test_drift_shifts_rx_windows);
+  RUN_TEST(test_narrow_window_opens_less_early);
+  RUN_TEST(test_missed_windows_open_again);
+  RUN_TEST(test_no_calibration_without_clock_error);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,120 @@
+#include <Arduino.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <stdlib.h>
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = 1,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+#define MAX_LATE 8
+
+static unsigned lateHist[MAX_LATE + 1];
+
+void setUp(void)
+{
+  sim.irqAt = 0;
+  sim.primask = 0;
+  sim.wakeups = 0;
+  sim.sleptUs = 0;
+}
+
+void tearDown(void) {}
+
+// Wait for a target time, return how many ticks late we were.
+static s4_t waitFor(u4_t target)
+{
+  hal_waitUntil(target);
+  return (s4_t)(hal_ticks() - target);
+}
+
+void test_wait_lateness_is_bounded(void)
+{
+  char msg[80];
+  s4_t worst = 0;
+  srand(1);
+  memset(lateHist, 0, sizeof(lateHist));
+  for (int i = 0; i < 5000; i++) {
+    u4_t delta = rand() % ms2osticks(50);
+    u4_t target = hal_ticks() + delta;
+    // random UART/other interrupt waking the core early
+    sim.irqAt = (rand() & 1) ? sim.us + rand() % 50000 : 0;
+    s4_t late = waitFor(target);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, late);
+    if (late > worst)
+      worst = late;
+    lateHist[late < MAX_LATE ? late : MAX_LATE]++;
+  }
+  for (int i = 0; i <= MAX_LATE; i++) {
+    snprintf(msg, sizeof(msg), "late %d%s ticks: %u", i, i == MAX_LATE ? "+" : "", lateHist[i]);
+    TEST_MESSAGE(msg);
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(1, worst);
+}
+
+void test_wait_sleeps_for_long_delays(void)
+{
+  uint64_t start = sim.us;
+  TEST_ASSERT_LESS_OR_EQUAL(1, waitFor(hal_ticks() + ms2osticks(100)));
+  uint64_t spun = sim.us - start - sim.sleptUs - sim.wakeups * sim.isrUs;
+  // Only the last SysTick period plus wakeup margin is spent spinning
+  TEST_ASSERT_GREATER_OR_EQUAL(98000, sim.sleptUs);
+  TEST_ASSERT_LESS_OR_EQUAL(1100 + 2 * US_PER_OSTICK, spun);
+}
+
+void test_wait_short_delay_does_not_sleep(void)
+{
+  TEST_ASSERT_LESS_OR_EQUAL(1, waitFor(hal_ticks() + us2osticks(500)));
+  TEST_ASSERT_EQUAL_UINT32(0, sim.wakeups);
+}
+
+void test_wait_in_the_past_returns_at_once(void)
+{
+  uint64_t start = sim.us;
+  hal_waitUntil(hal_ticks() - ms2osticks(10));
+  TEST_ASSERT_LESS_OR_EQUAL(US_PER_OSTICK, sim.us - start);
+  TEST_ASSERT_EQUAL_UINT32(0, sim.wakeups);
+}
+
+void test_wait_keeps_interrupts_disabled(void)
+{
+  hal_disableIRQs();
+  TEST_ASSERT_LESS_OR_EQUAL(1, waitFor(hal_ticks() + ms2osticks(20)));
+  TEST_ASSERT_EQUAL_UINT32(1, sim.primask);
+  // still sleeping between the SysTicks, which wake up the masked core
+  TEST_ASSERT_GREATER_OR_EQUAL(18, sim.wakeups);
+  hal_enableIRQs();
+  TEST_ASSERT_EQUAL_UINT32(0, sim.primask);
+}
+
+// Time in stop mode, where micros() does not count, made up for afterwards
+void test_add_ticks_moves_the_clock(void)
+{
+  u4_t before = hal_ticks();
+  hal_addTicks(ms2osticks(300000));
+  TEST_ASSERT_INT_WITHIN(1, ms2osticks(300000), hal_ticks() - before);
+  // and waiting still works from there
+  TEST_ASSERT_LESS_OR_EQUAL(1, waitFor(hal_ticks() + ms2osticks(20)));
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_wait_lateness_is_bounded);
+  RUN_TEST(test_wait_sleeps_for_long_delays);
+  RUN_TEST(test_wait_short_delay_does_not_sleep);
+  RUN_TEST(test_wait_in_the_past_returns_at_once);
+  RUN_TEST(test_wait_keeps_interrupts_disabled);
+  RUN_TEST(test_add_ticks_moves_the_clock);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,141 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <stdlib.h>
+
+#define PIN_NSS 1
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = PIN_NSS,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// Just enough of an SX1276 to get through radio_init() and to catch the
+// frame of a TX: a plain register file with the FIFO behind RegFifo
+static uint8_t regs[0x80];
+static uint8_t fifo[256];
+static int spiPos;
+static uint8_t spiAddr;
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == PIN_NSS && val == 0)
+    spiPos = 0;
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    if (addr == 0x00)
+      fifo[regs[0x0D]++] = out;
+    else
+      regs[addr] = out;
+    return 0;
+  }
+  if (addr == 0x2C) // RegRssiWideband
+    return rand();
+  return regs[addr];
+}
+
+static u1_t nwkKey[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static u1_t artKey[16] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+static u1_t payload[4] = {1, 2, 3, 4};
+
+// Queue an uplink, the bands are free so it goes out right away
+static void send(void)
+{
+  memset(fifo, 0, sizeof(fifo));
+  LMIC_setTxData2(1, payload, sizeof(payload), 0);
+  os_runloop_once();
+}
+
+void setUp(void)
+{
+  memset(regs, 0, sizeof(regs));
+  regs[0x42] = 0x12; // RegVersion
+  sim_pin_write = radioPin;
+  sim_spi_transfer = radioSpi;
+  os_init();
+  LMIC_reset();
+  LMIC_setSession(0x13, 0x26011BDA, nwkKey, artKey);
+  LMIC_setAdrMode(0);
+  LMIC_setLinkCheckMode(0);
+}
+
+void tearDown(void) {}
+
+void test_request_in_fopts(void)
+{
+  LMIC_requestLinkCheck();
+  LMIC.lchkGws = 3;
+  send();
+  TEST_ASSERT_EQUAL(1, fifo[OFF_DAT_FCT] & FCT_OPTLEN);
+  TEST_ASSERT_EQUAL_HEX8(MCMD_LCHK_REQ, fifo[OFF_DAT_OPTS]);
+  TEST_ASSERT_EQUAL(OFF_DAT_OPTS + 1 + 1 + sizeof(payload) + 4, LMIC.dataLen);
+  // the old answer is gone, the request only goes out once
+  TEST_ASSERT_EQUAL(0, LMIC.lchkGws);
+  TEST_ASSERT_FALSE(LMIC.lchkReq);
+}
+
+void test_no_request(void)
+{
+  send();
+  TEST_ASSERT_EQUAL(0, fifo[OFF_DAT_FCT] & FCT_OPTLEN);
+  TEST_ASSERT_EQUAL(1, fifo[OFF_DAT_OPTS]); // FPort
+}
+
+void test_answer_cleared_on_next_uplink(void)
+{
+  // an answer to the previous uplink
+  LMIC.lchkMargin = 20;
+  LMIC.lchkGws = 1;
+  send();
+  TEST_ASSERT_EQUAL(0, fifo[OFF_DAT_FCT] & FCT_OPTLEN);
+  TEST_ASSERT_EQUAL(0, LMIC.lchkGws);
+  TEST_ASSERT_EQUAL(255, LMIC.lchkMargin);
+}
+
+void test_txpow_follows_adr_power(void)
+{
+  // 14 dBm band limit by default
+  send();
+  TEST_ASSERT_EQUAL(14, LMIC.txpow);
+  TEST_ASSERT_EQUAL_HEX8(0x80 | (14 - 2), regs[0x09]); // RegPaConfig, PA_BOOST
+
+  // less when asked for, the band limit stays the upper bound
+  setUp();
+  LMIC_setDrTxpow(DR_SF9, 8);
+  send();
+  TEST_ASSERT_EQUAL(8, LMIC.txpow);
+  TEST_ASSERT_EQUAL_HEX8(0x80 | (8 - 2), regs[0x09]);
+
+  setUp();
+  LMIC_setDrTxpow(DR_SF9, 20);
+  send();
+  TEST_ASSERT_EQUAL(14, LMIC.txpow);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_request_in_fopts);
+  RUN_TEST(test_no_request);
+  RUN_TEST(test_answer_cleared_on_next_uplink);
+  RUN_TEST(test_txpow_follows_adr_power);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
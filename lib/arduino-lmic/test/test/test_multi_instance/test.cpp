@@ -0,0 +1,185 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <stdlib.h>
+
+// Several stacks in one process, only built with LMIC_MULTI_INSTANCE
+// (pio test -e native_multi)
+
+#define PIN_NSS 1
+#define NODES 3
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = PIN_NSS,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// A stack with its radio: a plain register file with the FIFO behind
+// RegFifo, found through the user pointer of the current context
+struct Node {
+  lmic_ctx_t ctx;
+  uint8_t regs[0x80];
+  uint8_t fifo[256];
+};
+
+static Node nodes[NODES];
+static lmic_ctx_t *builtin;
+static int spiPos;
+static uint8_t spiAddr;
+
+static Node &current(void) { return *(Node *)LMIC_CTX->user; }
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == PIN_NSS && val == 0)
+    spiPos = 0;
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  Node &n = current();
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    if (addr == 0x00)
+      n.fifo[n.regs[0x0D]++] = out;
+    else
+      n.regs[addr] = out;
+    return 0;
+  }
+  if (addr == 0x2C) // RegRssiWideband
+    return rand();
+  return n.regs[addr];
+}
+
+static u1_t payload[4] = {1, 2, 3, 4};
+
+static void use(int i) { LMIC_CTX = &nodes[i].ctx; }
+
+// Queue an uplink, the bands are free so it goes out right away
+static void send(int i)
+{
+  use(i);
+  memset(nodes[i].fifo, 0, sizeof(nodes[i].fifo));
+  LMIC_setTxData2(1, payload, sizeof(payload), 0);
+  os_runloop_once();
+}
+
+void setUp(void)
+{
+  sim_pin_write = radioPin;
+  sim_spi_transfer = radioSpi;
+  for (int i = 0; i < NODES; i++) {
+    Node &n = nodes[i];
+    memset(&n, 0, sizeof(n));
+    n.ctx.user = &n;
+    n.regs[0x42] = 0x12; // RegVersion
+    u1_t nwkKey[16], artKey[16];
+    memset(nwkKey, 0x10 + i, sizeof(nwkKey));
+    memset(artKey, 0x20 + i, sizeof(artKey));
+    use(i);
+    os_init();
+    LMIC_reset();
+    LMIC_setSession(0x13, 0x26011B00 + i, nwkKey, artKey);
+    LMIC_setAdrMode(0);
+    LMIC_setLinkCheckMode(0);
+  }
+}
+
+void tearDown(void) { LMIC_CTX = builtin; }
+
+void test_builtin_context(void)
+{
+  TEST_ASSERT_NOT_NULL(builtin);
+  for (int i = 0; i < NODES; i++)
+    TEST_ASSERT_TRUE(builtin != &nodes[i].ctx);
+}
+
+void test_frames_per_stack(void)
+{
+  use(0);
+  LMIC.seqnoUp = 100;
+  send(0);
+  send(1);
+  for (int i = 0; i < 2; i++) {
+    uint8_t *f = nodes[i].fifo;
+    TEST_ASSERT_EQUAL_HEX32(0x26011B00 + i, os_rlsbf4(f + OFF_DAT_ADDR));
+    TEST_ASSERT_EQUAL(i == 0 ? 100 : 0, os_rlsbf2(f + OFF_DAT_SEQNO));
+    use(i);
+    TEST_ASSERT_EQUAL(i == 0 ? 101 : 1, LMIC.seqnoUp);
+  }
+  // the third one has sent nothing
+  use(2);
+  TEST_ASSERT_EQUAL(0, LMIC.seqnoUp);
+  TEST_ASSERT_EQUAL(0, nodes[2].fifo[0]);
+}
+
+void test_keys_per_stack(void)
+{
+  // same payload and FCnt, but other keys: other MIC and ciphertext
+  send(0);
+  send(1);
+  use(0);
+  u1_t len = LMIC.dataLen;
+  TEST_ASSERT_FALSE(memcmp(nodes[0].fifo + OFF_DAT_OPTS + 1, nodes[1].fifo + OFF_DAT_OPTS + 1,
+                           len - OFF_DAT_OPTS - 1) == 0);
+  use(1);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(nodes[1].fifo, LMIC.frame, len);
+}
+
+static int ran;
+static void countJob(osjob_t *job) { ran++; }
+
+void test_job_queues_per_stack(void)
+{
+  static osjob_t job;
+  ran = 0;
+  use(0);
+  os_setCallback(&job, countJob);
+  use(1);
+  os_runloop_once();
+  TEST_ASSERT_EQUAL(0, ran);
+  use(0);
+  os_runloop_once();
+  TEST_ASSERT_EQUAL(1, ran);
+}
+
+void test_radio_shadow_per_stack(void)
+{
+  // a stack does not skip register writes because another stack's
+  // radio already has the value
+  send(0);
+  send(1);
+  for (int i = 0; i < 2; i++) {
+    TEST_ASSERT_EQUAL_HEX8(0x80 | (14 - 2), nodes[i].regs[0x09]); // RegPaConfig
+    TEST_ASSERT_NOT_EQUAL(0, nodes[i].regs[0x1D]);                // RegModemConfig1
+  }
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_builtin_context);
+  RUN_TEST(test_frames_per_stack);
+  RUN_TEST(test_keys_per_stack);
+  RUN_TEST(test_job_queues_per_stack);
+  RUN_TEST(test_radio_shadow_per_stack);
+  return UNITY_END();
+}
+
+int main(void)
+{
+  builtin = LMIC_CTX;
+  return runUnityTests();
+}
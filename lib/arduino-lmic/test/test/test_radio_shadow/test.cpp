@@ -0,0 +1,166 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <stdlib.h>
+
+#define PIN_NSS 1
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = PIN_NSS,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// Just enough of an SX1276 to get through radio_init() and a TX: a plain
+// register file, RegVersion, random RssiWideband and a mode that follows
+// RegOpMode.
+static uint8_t regs[0x80];
+static uint8_t fifo[256];
+static int spiPos;        // byte position in current transaction
+static uint8_t spiAddr;
+static unsigned transactions;
+static unsigned regWrites;
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == PIN_NSS && val == 0) {
+    spiPos = 0;
+    transactions++;
+  }
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    if (addr == 0x00)
+      fifo[regs[0x0D]++] = out;
+    else {
+      regs[addr] = out;
+      regWrites++;
+    }
+    return 0;
+  }
+  if (addr == 0x00)
+    return fifo[regs[0x0D]++];
+  if (addr == 0x2C) // RegRssiWideband
+    return rand();
+  return regs[addr];
+}
+
+static unsigned txTransactions()
+{
+  transactions = 0;
+  LMIC.rps = updr2rps(DR_SF9);
+  LMIC.freq = 868100000;
+  LMIC.txpow = 14;
+  LMIC.dataLen = 20;
+  os_radio(RADIO_TX);
+  // TX done: the radio falls back to standby and raises DIO0
+  regs[0x01] = (regs[0x01] & ~0x07) | 0x01;
+  regs[0x12] = 0x08;
+  radio_irq_handler(0);
+  return transactions;
+}
+
+void setUp(void)
+{
+  memset(regs, 0, sizeof(regs));
+  regs[0x42] = 0x12; // RegVersion
+  sim_pin_write = radioPin;
+  sim_spi_transfer = radioSpi;
+  os_init();
+}
+
+void tearDown(void) {}
+
+void test_repeated_tx_skips_unchanged_registers(void)
+{
+  unsigned first = txTransactions();
+  uint8_t chip[sizeof(regs)];
+  memcpy(chip, regs, sizeof(regs));
+  unsigned second = txTransactions();
+  char msg[64];
+  snprintf(msg, sizeof(msg), "SPI transactions per TX: %u, then %u", first, second);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_LESS_THAN(first, second);
+  // the chip still ends up with the same configuration
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(chip + 0x01, regs + 0x01, 0x11);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(chip + 0x13, regs + 0x13, sizeof(regs) - 0x13);
+}
+
+void test_changed_registers_are_written(void)
+{
+  txTransactions();
+  regWrites = 0;
+  LMIC.freq = 868300000;
+  transactions = 0;
+  LMIC.rps = updr2rps(DR_SF12);
+  LMIC.txpow = 14;
+  os_radio(RADIO_TX);
+  uint64_t frf = ((uint64_t)868300000 << 19) / 32000000;
+  TEST_ASSERT_EQUAL_HEX8((uint8_t)(frf >> 16), regs[0x06]);
+  TEST_ASSERT_EQUAL_HEX8((uint8_t)(frf >> 8), regs[0x07]);
+  TEST_ASSERT_EQUAL_HEX8((uint8_t)frf, regs[0x08]);
+  // SF12 in ModemConfig2, low data rate optimize in ModemConfig3
+  TEST_ASSERT_EQUAL_HEX8(0xC0, regs[0x1E] & 0xF0);
+  TEST_ASSERT_EQUAL_HEX8(0x08, regs[0x26] & 0x08);
+}
+
+void test_prepared_tx_only_loads_frame(void)
+{
+  unsigned full = txTransactions();
+  transactions = 0;
+  LMIC.rps = updr2rps(DR_SF9);
+  os_radio(RADIO_TXPREP);
+  // radio is awake (standby) before the frame is handed over
+  TEST_ASSERT_EQUAL_HEX8(0x01, regs[0x01] & 0x07);
+  unsigned prep = transactions;
+  transactions = 0;
+  LMIC.freq = 868500000;
+  LMIC.txpow = 14;
+  LMIC.dataLen = 20;
+  os_radio(RADIO_TX);
+  unsigned tx = transactions;
+  char msg[64];
+  snprintf(msg, sizeof(msg), "SPI transactions: prepare %u, after frame %u", prep, tx);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_LESS_THAN(full, tx);
+  TEST_ASSERT_EQUAL_HEX8(0x03, regs[0x01] & 0x07); // TX
+  TEST_ASSERT_EQUAL_HEX8(20, regs[0x22]);
+}
+
+void test_reset_drops_shadow(void)
+{
+  txTransactions();
+  // radio reset behind our back, as on a re-init
+  memset(regs, 0, sizeof(regs));
+  regs[0x42] = 0x12;
+  radio_init();
+  txTransactions();
+  TEST_ASSERT_EQUAL_HEX8(0x34, regs[0x39]); // LoRaWAN sync word
+  TEST_ASSERT_EQUAL_HEX8(0x04, regs[0x5A] & 0x04);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_repeated_tx_skips_unchanged_registers);
+  RUN_TEST(test_changed_registers_are_written);
+  RUN_TEST(test_prepared_tx_only_loads_frame);
+  RUN_TEST(test_reset_drops_shadow);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
@@ -0,0 +1,207 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <stdlib.h>
+
+#define PIN_NSS 1
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = PIN_NSS,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = 2,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// Just enough of an SX1276 to get through radio_init(): a plain register
+// file with RegVersion and a noisy RssiWideband for the random seed
+static uint8_t regs[0x80];
+static int spiPos;
+static uint8_t spiAddr;
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == PIN_NSS && val == 0)
+    spiPos = 0;
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    regs[addr] = out;
+    return 0;
+  }
+  if (addr == 0x2C) // RegRssiWideband
+    return rand();
+  return regs[addr];
+}
+
+static u1_t nwkKey[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static u1_t artKey[16] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+static u1_t buf[LMIC_SESSION_SIZE + 8];
+
+// A session in the state it has after some uplinks
+static void makeSession(void)
+{
+  LMIC_reset();
+  LMIC_setClockError(MAX_CLOCK_ERROR * 25 / 100);
+  LMIC_setSession(0x13, 0x26011BDA, nwkKey, artKey);
+  LMIC_setupChannel(3, 867100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
+  LMIC.seqnoUp = 1234;
+  LMIC.seqnoDn = 56;
+  LMIC.datarate = DR_SF9;
+  LMIC.adrTxPow = 11;
+  LMIC.rxDelay = 5;
+  LMIC.dn2Dr = DR_SF9;
+  LMIC.ladrAns = 1;
+  LMIC.bands[BAND_CENTI].avail = os_getTime() + sec2osticks(30);
+  LMIC.globalDutyAvail = os_getTime() - sec2osticks(1);
+#if !defined(DISABLE_CLOCK_CAL)
+  LMIC.clockDrift = -1234;
+  LMIC.clockDev = 77;
+  LMIC.clockCalCnt = 5;
+#endif
+}
+
+void setUp(void)
+{
+  memset(regs, 0, sizeof(regs));
+  regs[0x42] = 0x12; // RegVersion
+  sim_pin_write = radioPin;
+  sim_spi_transfer = radioSpi;
+  os_init();
+  makeSession();
+}
+
+void tearDown(void) {}
+
+void test_round_trip(void)
+{
+  struct lmic_t saved = LMIC;
+  u1_t len = LMIC_saveSession(buf);
+  TEST_ASSERT_LESS_OR_EQUAL(LMIC_SESSION_SIZE, len);
+
+  LMIC_reset();
+  LMIC_setClockError(MAX_CLOCK_ERROR * 25 / 100);
+  TEST_ASSERT_TRUE(LMIC_restoreSession(buf, len, 0));
+
+  TEST_ASSERT_EQUAL_HEX32(saved.devaddr, LMIC.devaddr);
+  TEST_ASSERT_EQUAL_HEX32(saved.netid, LMIC.netid);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(nwkKey, LMIC.nwkKey, 16);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(artKey, LMIC.artKey, 16);
+  TEST_ASSERT_EQUAL(1234, LMIC.seqnoUp);
+  TEST_ASSERT_EQUAL(56, LMIC.seqnoDn);
+  TEST_ASSERT_EQUAL_HEX16(saved.channelMap, LMIC.channelMap);
+  TEST_ASSERT_EQUAL_HEX32_ARRAY(saved.channelFreq, LMIC.channelFreq, MAX_CHANNELS);
+  TEST_ASSERT_EQUAL_HEX16_ARRAY(saved.channelDrMap, LMIC.channelDrMap, MAX_CHANNELS);
+  for (u1_t b = 0; b < MAX_BANDS; b++) {
+    TEST_ASSERT_EQUAL(saved.bands[b].txcap, LMIC.bands[b].txcap);
+    TEST_ASSERT_EQUAL(saved.bands[b].txpow, LMIC.bands[b].txpow);
+  }
+  TEST_ASSERT_EQUAL(DR_SF9, LMIC.datarate);
+  TEST_ASSERT_EQUAL(11, LMIC.adrTxPow);
+  TEST_ASSERT_EQUAL(5, LMIC.rxDelay);
+  TEST_ASSERT_EQUAL(DR_SF9, LMIC.dn2Dr);
+  TEST_ASSERT_EQUAL(saved.dn2Freq, LMIC.dn2Freq);
+  TEST_ASSERT_EQUAL(saved.adrAckReq, LMIC.adrAckReq);
+  TEST_ASSERT_TRUE(LMIC.ladrAns);
+  TEST_ASSERT_FALSE(LMIC.devsAns);
+#if !defined(DISABLE_CLOCK_CAL)
+  TEST_ASSERT_EQUAL(-1234, LMIC.clockDrift);
+  TEST_ASSERT_EQUAL(77, LMIC.clockDev);
+  TEST_ASSERT_EQUAL(5, LMIC.clockCalCnt);
+  // the RX windows are sized from the restored calibration again
+  TEST_ASSERT_EQUAL(4 * 77 + MAX_CLOCK_ERROR / 1000, LMIC.clockError);
+#endif
+  // ready to pick a channel for the next uplink
+  TEST_ASSERT_TRUE(LMIC.opmode & OP_NEXTCHNL);
+  TEST_ASSERT_FALSE(LMIC.opmode & OP_TXRXPEND);
+}
+
+void test_times_relative(void)
+{
+  u1_t len = LMIC_saveSession(buf);
+
+  // 10 s later after a reboot, the clock starts over
+  delay(100);
+  LMIC_reset();
+  TEST_ASSERT_TRUE(LMIC_restoreSession(buf, len, sec2osticks(10)));
+  ostime_t left = LMIC.bands[BAND_CENTI].avail - os_getTime();
+  TEST_ASSERT_INT32_WITHIN(ms2osticks(10), sec2osticks(20), left);
+  // what had passed stays passed
+  TEST_ASSERT_INT32_WITHIN(ms2osticks(10), 0, LMIC.globalDutyAvail - os_getTime());
+
+  // and long after, everything is free
+  LMIC_reset();
+  TEST_ASSERT_TRUE(LMIC_restoreSession(buf, len, sec2osticks(3600)));
+  TEST_ASSERT_INT32_WITHIN(ms2osticks(10), 0, LMIC.bands[BAND_CENTI].avail - os_getTime());
+}
+
+void test_all_channels_fit(void)
+{
+  for (u1_t ch = 0; ch < MAX_CHANNELS; ch++)
+    LMIC_setupChannel(ch, 867000000 + ch * 200000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
+  u1_t len = LMIC_saveSession(buf);
+  TEST_ASSERT_EQUAL(LMIC_SESSION_SIZE, len);
+  LMIC_reset();
+  TEST_ASSERT_TRUE(LMIC_restoreSession(buf, len, 0));
+  TEST_ASSERT_EQUAL(867000000 + 15 * 200000, LMIC.channelFreq[15] & ~3);
+}
+
+void test_bad_buffer(void)
+{
+  u1_t len = LMIC_saveSession(buf);
+  LMIC_reset();
+
+  TEST_ASSERT_FALSE(LMIC_restoreSession(buf, len - 1, 0));
+  TEST_ASSERT_FALSE(LMIC_restoreSession(buf, 10, 0));
+  buf[0] ^= 0xFF;
+  TEST_ASSERT_FALSE(LMIC_restoreSession(buf, len, 0));
+  // nothing was taken over
+  TEST_ASSERT_EQUAL(0, LMIC.devaddr);
+  TEST_ASSERT_EQUAL(0, LMIC.seqnoUp);
+}
+
+void test_bad_channel_index(void)
+{
+  LMIC_setupChannel(3, 867100000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
+  u1_t len = LMIC_saveSession(buf);
+  LMIC_reset();
+
+  // the entry of the first channel, after version, ids, keys, counters,
+  // channel map and channel count
+  u1_t *ch = buf + 1 + 4 + 4 + 16 + 16 + 4 + 4 + 2 + 1;
+  TEST_ASSERT_EQUAL(0, *ch);
+  *ch = MAX_CHANNELS;
+  TEST_ASSERT_FALSE(LMIC_restoreSession(buf, len, 0));
+  *ch = 0xFF;
+  TEST_ASSERT_FALSE(LMIC_restoreSession(buf, len, 0));
+  TEST_ASSERT_EQUAL(0, LMIC.devaddr);
+  TEST_ASSERT_EQUAL(0, LMIC.channelFreq[3]);
+  *ch = 0;
+  TEST_ASSERT_TRUE(LMIC_restoreSession(buf, len, 0));
+  TEST_ASSERT_EQUAL(867100000, LMIC.channelFreq[3] & ~3);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_times_relative);
+  RUN_TEST(test_all_channels_fit);
+  RUN_TEST(test_bad_buffer);
+  RUN_TEST(test_bad_channel_index);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
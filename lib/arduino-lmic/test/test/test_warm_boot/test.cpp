@@ -0,0 +1,132 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "unity.h"
+#include <stdlib.h>
+
+#define PIN_NSS 1
+#define PIN_RST 2
+
+// clang-format off
+const lmic_pinmap lmic_pins = {
+  .nss = PIN_NSS,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = PIN_RST,
+  .dio = {3, 4, LMIC_UNUSED_PIN},
+};
+// clang-format on
+
+void onEvent(ev_t ev) {}
+
+// A plain SX1276 register file with RegVersion and a noisy RssiWideband.
+// Counts the noise samples and the resets.
+static uint8_t regs[0x80];
+static int spiPos;
+static uint8_t spiAddr;
+static unsigned rssiReads;
+static unsigned resets;
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == PIN_NSS && val == 0)
+    spiPos = 0;
+  if (pin == PIN_RST && val == 0)
+    resets++;
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    regs[addr] = out;
+    return 0;
+  }
+  if (addr == 0x2C) { // RegRssiWideband
+    rssiReads++;
+    return rand();
+  }
+  return regs[addr];
+}
+
+void setUp(void)
+{
+  memset(regs, 0, sizeof(regs));
+  regs[0x42] = 0x12; // RegVersion
+  rssiReads = 0;
+  resets = 0;
+  sim_pin_write = radioPin;
+  sim_spi_transfer = radioSpi;
+}
+
+void tearDown(void) {}
+
+void test_cold_boot_resets_and_samples_noise(void)
+{
+  os_init();
+  TEST_ASSERT_EQUAL(1, resets);
+  TEST_ASSERT_GREATER_OR_EQUAL(2 * 8 * 15, rssiReads);
+}
+
+void test_warm_boot_keeps_radio_and_skips_noise(void)
+{
+  u1_t seed[RADIO_RAND_SEED_SIZE];
+  os_init();
+  radio_getRandSeed(seed);
+  resets = 0;
+  rssiReads = 0;
+  regs[0x01] = 0x80; // LoRa sleep, as left before the MCU standby
+  regs[0x1D] = 0x72; // some configuration the radio kept
+
+  uint32_t start = micros();
+  os_initWarm(seed);
+  uint32_t took = micros() - start;
+
+  TEST_ASSERT_EQUAL(0, resets);
+  TEST_ASSERT_EQUAL(0, rssiReads);
+  TEST_ASSERT_EQUAL_HEX8(0x72, regs[0x1D]);
+  TEST_ASSERT_EQUAL_HEX8(0x00, regs[0x01] & 0x07); // still asleep
+  // no reset and settling delays
+  TEST_ASSERT_LESS_THAN(1000, took);
+}
+
+void test_warm_boot_continues_random_sequence(void)
+{
+  u1_t seed[RADIO_RAND_SEED_SIZE];
+  u1_t cold[40];
+  os_init();
+  for (int i = 0; i < 5; i++)
+    os_getRndU1();
+  radio_getRandSeed(seed);
+  for (int i = 0; i < 40; i++)
+    cold[i] = os_getRndU1();
+
+  os_initWarm(seed);
+  for (int i = 0; i < 40; i++)
+    TEST_ASSERT_EQUAL_HEX8(cold[i], os_getRndU1());
+}
+
+void test_warm_boot_with_blank_seed(void)
+{
+  u1_t seed[RADIO_RAND_SEED_SIZE] = {0};
+  os_initWarm(seed);
+  // an invalid index is not used as is, the generator still works
+  os_getRndU1();
+  os_getRndU1();
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_cold_boot_resets_and_samples_noise);
+  RUN_TEST(test_warm_boot_keeps_radio_and_skips_noise);
+  RUN_TEST(test_warm_boot_continues_random_sequence);
+  RUN_TEST(test_warm_boot_with_blank_seed);
+  return UNITY_END();
+}
+
+int main(void) { return runUnityTests(); }
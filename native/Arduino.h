@@ -0,0 +1,228 @@
+/*
+  Arduino.h
+  Minimal simulated Arduino/STM32 core to run the LMIC HAL and the firmware
+  on the host. Time is virtual: it only advances when the code under test
+  reads the clock, delays or sleeps, and sleeping jumps straight to the
+  wakeup. SysTick fires every millisecond like on the MiniPill, but a WFI
+  after sim_wakeup_in() sleeps through the ticks before the armed time
+  (they would only wake the core to go back to sleep).
+*/
+#ifndef _sim_arduino_h_
+#define _sim_arduino_h_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+
+#define ARDUINO_ARCH_STM32
+// the STM32 core whose API the simulated one follows (SPI.h)
+#define STM32_CORE_VERSION 0x02070000
+
+#define LOW    0
+#define HIGH   1
+#define INPUT  0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_ANALOG 3
+
+#define RISING  4
+#define FALLING 3
+#define CHANGE  2
+
+#define DEC 10
+#define HEX 16
+
+#define NUM_SIM_PINS 64
+
+// MiniPill pin names
+enum {
+  PA0, PA1, PA2, PA3, PA4, PA5, PA6, PA7, PA8, PA9, PA10, PA11, PA12, PA13, PA14, PA15,
+  PB0, PB1, PB2, PB3, PB4, PB5, PB6, PB7, PB8, PB9, PB10, PB11, PB12, PB13, PB14, PB15,
+};
+
+struct SimCore {
+  uint64_t us;        // virtual time in microseconds
+  uint64_t bootUs;    // virtual time of the last reset, micros() counts from there
+  uint32_t cost;      // time spent per clock or pin read (us)
+  uint32_t isrUs;     // wakeup + ISR latency after an interrupt (us)
+  uint64_t irqAt;     // pending external interrupt at this time (0 = none)
+  uint32_t primask;   // 1 = interrupts masked
+  uint32_t wakeups;   // number of WFI wakeups
+  uint64_t sleptUs;   // time spent in WFI
+  uint8_t pins[NUM_SIM_PINS];
+  // low power modes, see STM32LowPower.h
+  uint32_t standby;   // woken up from standby (PWR_FLAG_SB)
+  uint32_t shutdowns; // number of standby entries
+  uint32_t stops;     // number of stop mode entries
+  uint64_t lowPowerUs; // time spent in stop or standby
+  uint64_t standbyUs; // of that in standby
+  uint64_t timerAt;   // wakeup armed for the next WFI (0 = none)
+  uint64_t stoppedUs; // time in stop mode since the reset, SysTick stood still
+};
+
+inline SimCore sim = {0, 0, 1, 5, 0, 0, 0, 0, {0}, 0, 0, 0, 0, 0, 0, 0};
+
+// Arms the wakeup of the next WFI, hal_sleep() of sim_hal.cpp uses it for
+// the next timed LMIC job
+inline void sim_wakeup_in(uint32_t us) { sim.timerAt = sim.us + us; }
+
+inline uint32_t micros() {
+  sim.us += sim.cost;
+  return (uint32_t)(sim.us - sim.bootUs - sim.stoppedUs);
+}
+inline uint32_t millis() { return (uint32_t)(micros() / 1000); }
+inline void delay(uint32_t ms) { sim.us += (uint64_t)ms * 1000; }
+inline void delayMicroseconds(uint32_t us) { sim.us += us; }
+
+inline void pinMode(uint32_t pin, uint32_t mode) {}
+// Called on every digitalWrite (e.g. a radio model watching NSS)
+inline void (*sim_pin_write)(uint32_t pin, uint32_t val) = 0;
+
+inline void digitalWrite(uint32_t pin, uint32_t val) {
+  sim.pins[pin % NUM_SIM_PINS] = val;
+  if (sim_pin_write)
+    sim_pin_write(pin, val);
+}
+// Called on every digitalRead before the level is sampled (e.g. a radio
+// model raising DIO once the airtime has passed)
+inline void (*sim_pin_read)(uint32_t pin) = 0;
+
+// Reading a pin takes time like reading the clock, so polling a DIO in
+// a loop gets to the airtime's end
+inline int digitalRead(uint32_t pin) {
+  sim.us += sim.cost;
+  if (sim_pin_read)
+    sim_pin_read(pin);
+  return sim.pins[pin % NUM_SIM_PINS];
+}
+
+// Interrupts only wake the core here: the radio model sets sim.irqAt
+#define digitalPinToInterrupt(p) (p)
+inline void attachInterrupt(uint32_t pin, void (*callback)(void), uint32_t mode) {}
+inline void detachInterrupt(uint32_t pin) {}
+
+inline void noInterrupts() { sim.primask = 1; }
+inline void interrupts() { sim.primask = 0; }
+
+// CMSIS intrinsics
+inline uint32_t __get_PRIMASK() { return sim.primask; }
+inline void __disable_irq() { sim.primask = 1; }
+inline void __enable_irq() { sim.primask = 0; }
+// Sleep until the next SysTick (the first at or after the armed wakeup)
+// or the pending external interrupt.
+inline void __WFI() {
+  uint64_t wake = (sim.us / 1000 + 1) * 1000;
+  if (sim.timerAt > wake)
+    wake = (sim.timerAt + 999) / 1000 * 1000;
+  sim.timerAt = 0;
+  if (sim.irqAt > sim.us && sim.irqAt < wake)
+    wake = sim.irqAt;
+  sim.sleptUs += wake - sim.us;
+  sim.us = wake + sim.isrUs;
+  sim.wakeups++;
+}
+
+// Flash strings are plain strings here
+#define PROGMEM
+#define F(s) (s)
+#define memcpy_P memcpy
+#define pgm_read_word_near(p) (*(const uint16_t *)(p))
+
+inline char *dtostrf(double val, signed char width, unsigned char prec, char *buf) {
+  sprintf(buf, "%*.*f", width, prec, val);
+  return buf;
+}
+
+// UART peripherals for the HardwareSerial constructor
+#define USART1 ((void *)1)
+#define USART2 ((void *)2)
+
+class HardwareSerial;
+// Called when the firmware polls a serial port for input (e.g. a meter
+// model feeding bytes as they would arrive by now)
+inline void (*sim_uart_poll)(HardwareSerial &port) = 0;
+// Where all serial output goes, NULL to drop it
+inline FILE *sim_uart_out = stderr;
+
+// Like the STM32 core
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+#endif
+
+class HardwareSerial {
+public:
+  std::deque<uint8_t> rx; // received bytes not read yet
+  bool open = false;
+  uint64_t openSince = 0; // virtual time of begin()
+
+  HardwareSerial(void *peripheral) {}
+  HardwareSerial(uint32_t rxPin, uint32_t txPin) {}
+  void begin(uint32_t baud) {
+    rx.clear();
+    open = true;
+    openSince = sim.us;
+  }
+  void end() { open = false; }
+  void flush() {}
+
+  // A byte off the line, false if the RX buffer is full
+  bool receive(uint8_t c) {
+    if (rx.size() >= SERIAL_RX_BUFFER_SIZE - 1)
+      return false;
+    rx.push_back(c);
+    return true;
+  }
+
+  int available() {
+    if (sim_uart_poll)
+      sim_uart_poll(*this);
+    return rx.size();
+  }
+  int read() {
+    if (available() == 0)
+      return -1;
+    uint8_t c = rx.front();
+    rx.pop_front();
+    return c;
+  }
+
+  size_t write(uint8_t c) { return sim_uart_out ? (fputc(c, sim_uart_out) == EOF ? 0 : 1) : 1; }
+  size_t print(const char *s) {
+    size_t n = 0;
+    while (*s)
+      n += write(*s++);
+    return n;
+  }
+  size_t print(char c) { return write(c); }
+  size_t print(unsigned long v, int base = DEC) {
+    char b[24];
+    snprintf(b, sizeof(b), base == HEX ? "%lX" : "%lu", v);
+    return print(b);
+  }
+  size_t print(long v, int base = DEC) {
+    if (base == HEX)
+      return print((unsigned long)v, base);
+    char b[24];
+    snprintf(b, sizeof(b), "%ld", v);
+    return print(b);
+  }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(double v, int digits = 2) {
+    char b[32];
+    snprintf(b, sizeof(b), "%.*f", digits, v);
+    return print(b);
+  }
+  size_t println() { return print('\n'); }
+  template <typename T> size_t println(T v) { return print(v) + println(); }
+  template <typename T> size_t println(T v, int base) { return print(v, base) + println(); }
+};
+
+inline HardwareSerial Serial(USART1);
+
+#include "sim_stm32.h"
+
+#endif // _sim_arduino_h_
@@ -0,0 +1,42 @@
+/*
+  SPI.h
+  Simulated SPI for the native tests. Transfers go to sim_spi_transfer
+  when set (a radio model), otherwise they read back 0.
+*/
+#ifndef _sim_spi_h_
+#define _sim_spi_h_
+
+#include <Arduino.h>
+
+#define MSBFIRST  1
+#define SPI_MODE0 0
+
+#define SPI_TRANSMITRECEIVE false
+#define SPI_TRANSMITONLY    true
+
+class SPISettings {
+public:
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+inline uint8_t (*sim_spi_transfer)(uint8_t out) = 0;
+
+class SPIClass {
+public:
+  void begin() {}
+  void beginTransaction(SPISettings settings) {}
+  void endTransaction() {}
+  uint8_t transfer(uint8_t out) { return sim_spi_transfer ? sim_spi_transfer(out) : 0; }
+  void transfer(void *buf, size_t count, bool skipReceive = SPI_TRANSMITRECEIVE) {
+    uint8_t *p = (uint8_t *)buf;
+    for (size_t i = 0; i < count; i++) {
+      uint8_t in = transfer(p[i]);
+      if (!skipReceive)
+        p[i] = in;
+    }
+  }
+};
+
+inline SPIClass SPI;
+
+#endif // _sim_spi_h_
@@ -0,0 +1,20 @@
+/*
+  STM32IntRef.h
+  Internal reference of the simulated STM32L0: a steady 3.3 V supply and
+  room temperature.
+*/
+#ifndef _sim_stm32intref_h_
+#define _sim_stm32intref_h_
+
+#include <Arduino.h>
+
+class STM32IntRef {
+public:
+  int32_t readVref() { return 3300; }
+  int32_t readTempSensor(int32_t VRef) { return 25; }
+  int32_t readVoltage(int32_t VRef, uint32_t pin) { return 0; }
+};
+
+inline STM32IntRef IntRef;
+
+#endif // _sim_stm32intref_h_
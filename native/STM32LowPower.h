@@ -0,0 +1,116 @@
+/*
+  STM32LowPower.h
+  Low power modes of the simulated STM32L0. Sleeping moves the virtual
+  clock to the wakeup time (or an earlier external interrupt, sim.irqAt).
+  shutdown() ends in a reset like on the chip: with the standby flag set,
+  the run starts over at the reset point the native main() has set.
+  SysTick stops in deepSleep() like in the stop mode of the chip, micros()
+  does not count the time asleep.
+  RAM is not cleared, setup() has to initialise what it uses anyway.
+*/
+#ifndef _sim_stm32lowpower_h_
+#define _sim_stm32lowpower_h_
+
+#include <Arduino.h>
+#include <STM32RTC.h>
+#include <setjmp.h>
+
+typedef void (*voidFuncPtrVoid)(void);
+typedef void (*voidFuncPtr)(void *);
+
+enum LP_Mode { IDLE_MODE, SLEEP_MODE, DEEP_SLEEP_MODE, SHUTDOWN_MODE };
+
+// Where a reset continues, valid when sim_reset_armed is set
+inline jmp_buf sim_reset_point;
+inline bool sim_reset_armed = false;
+
+// Called when the core enters (true) and leaves (false) stop mode, for
+// peripherals that stand still without their clocks (e.g. a USART)
+inline void (*sim_stop_hook)(bool enter) = 0;
+
+class STM32LowPower {
+public:
+  void begin() {}
+
+  void idle(uint32_t ms = 0) { wait(ms, false); }
+  void sleep(uint32_t ms = 0) { wait(ms, false); }
+  void deepSleep(uint32_t ms = 0) { stop(ms ? sim.us + (uint64_t)ms * 1000 : sim.irqAt); }
+  void shutdown(uint32_t ms = 0) {
+    uint64_t before = sim.lowPowerUs;
+    sim.shutdowns++;
+    wait(ms, true);
+    sim.standbyUs += sim.lowPowerUs - before;
+    sim.standby = 1;
+    sim.bootUs = sim.us;
+    sim.stoppedUs = 0;
+    if (sim_reset_armed)
+      longjmp(sim_reset_point, 1);
+  }
+
+  // The alarm matches the time of day, a time that has just passed comes
+  // again tomorrow
+  void deepSleepUntil(uint32_t dayMs) { deepSleep(untilMs(dayMs)); }
+  void shutdownUntil(uint32_t dayMs) { shutdown(untilMs(dayMs)); }
+
+  // The wakeup timer runs on from when the period was set
+  void deepSleepPeriodic(uint32_t ms) {
+    if (ms != wakeupPeriod) {
+      wakeupPeriod = ms;
+      wakeupStart = sim.us;
+    }
+    if (ms == 0) {
+      stop(sim.irqAt);
+      return;
+    }
+    uint64_t period = (uint64_t)ms * 1000;
+    stop(wakeupStart + ((sim.us - wakeupStart) / period + 1) * period);
+  }
+
+  void attachInterruptWakeup(uint32_t pin, voidFuncPtrVoid callback, uint32_t mode, LP_Mode lowPowerMode = SHUTDOWN_MODE) {}
+  void enableWakeupFrom(HardwareSerial *serial, voidFuncPtrVoid callback) {}
+  void enableWakeupFrom(STM32RTC *rtc, voidFuncPtr callback, void *data = NULL) {}
+
+  uint32_t wakeupLatency() { return latency; }
+
+private:
+  uint32_t latency = 0;
+  uint32_t wakeupPeriod = 0;
+  uint64_t wakeupStart = 0;
+
+  void stop(uint64_t wake) {
+    uint64_t before = sim.lowPowerUs;
+    sim.stops++;
+    if (sim_stop_hook)
+      sim_stop_hook(true);
+    waitUntil(wake, true);
+    sim.stoppedUs += sim.lowPowerUs - before;
+    if (sim_stop_hook)
+      sim_stop_hook(false);
+    // the clocks are back with the interrupt latency
+    latency = sim.isrUs;
+  }
+
+  uint32_t untilMs(uint32_t dayMs) {
+    uint32_t ms = (dayMs % 86400000 + 86400000 - STM32RTC::getInstance().getDayMs()) % 86400000;
+    return ms ? ms : 86400000;
+  }
+
+  // ms == 0 sleeps until the external interrupt
+  void wait(uint32_t ms, bool lowPower) { waitUntil(ms ? sim.us + (uint64_t)ms * 1000 : sim.irqAt, lowPower); }
+
+  void waitUntil(uint64_t wake, bool lowPower) {
+    if (sim.irqAt > sim.us && sim.irqAt < wake)
+      wake = sim.irqAt;
+    if (wake <= sim.us)
+      return;
+    if (lowPower)
+      sim.lowPowerUs += wake - sim.us;
+    else
+      sim.sleptUs += wake - sim.us;
+    sim.us = wake + sim.isrUs;
+  }
+};
+
+inline STM32LowPower LowPower;
+
+#endif // _sim_stm32lowpower_h_
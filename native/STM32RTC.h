@@ -0,0 +1,43 @@
+/*
+  STM32RTC.h
+  The RTC of the simulated STM32L0 counts the virtual time. It keeps
+  running through sleep and standby, like the LSE-clocked RTC of the
+  MiniPill.
+*/
+#ifndef _sim_stm32rtc_h_
+#define _sim_stm32rtc_h_
+
+#include <Arduino.h>
+
+// Epoch at virtual time 0
+inline uint32_t sim_rtc_epoch = 1609459200; // 2021-01-01
+
+class STM32RTC {
+public:
+  enum Hour_Format { HOUR_12, HOUR_24 };
+
+  static STM32RTC &getInstance() {
+    static STM32RTC instance;
+    return instance;
+  }
+
+  void begin(bool resetTime, Hour_Format format = HOUR_24) {}
+  void begin(Hour_Format format = HOUR_24) {}
+  bool isTimeSet() { return true; }
+
+  uint32_t getEpoch(uint32_t *subSeconds = nullptr) {
+    if (subSeconds)
+      *subSeconds = sim.us / 1000 % 1000;
+    return sim_rtc_epoch + sim.us / 1000000;
+  }
+  uint32_t getSubSeconds() { return sim.us / 1000 % 1000; }
+  void setEpoch(uint32_t ts, uint32_t subSeconds = 0) { sim_rtc_epoch = ts - sim.us / 1000000; }
+
+  // 24 hour format
+  uint32_t getDayMs() { return ((uint64_t)(sim_rtc_epoch % 86400) * 1000 + sim.us / 1000) % 86400000; }
+
+private:
+  STM32RTC() {}
+};
+
+#endif // _sim_stm32rtc_h_
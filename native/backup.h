@@ -0,0 +1,27 @@
+/*
+  backup.h
+  RTC backup registers of the simulated STM32L0, kept across a simulated
+  standby like on the chip.
+*/
+#ifndef _sim_backup_h_
+#define _sim_backup_h_
+
+#include <stdint.h>
+
+#define RTC_BKP_NUMBER 5
+#define RTC_BKP_INDEX  0
+#define RTC_BKP_VALUE  0x32F2
+
+inline uint32_t sim_backup[RTC_BKP_NUMBER];
+
+inline void enableBackupDomain() {}
+inline void disableBackupDomain() {}
+
+inline void setBackupRegister(uint32_t index, uint32_t value) {
+  if (index < RTC_BKP_NUMBER)
+    sim_backup[index] = value;
+}
+
+inline uint32_t getBackupRegister(uint32_t index) { return index < RTC_BKP_NUMBER ? sim_backup[index] : 0; }
+
+#endif // _sim_backup_h_
@@ -0,0 +1,27 @@
+/*
+  sim_hal.cpp
+  hal_sleep() of the LMIC HAL for the simulated MiniPill. It replaces the
+  weak one of hal/hal.cpp, which sleeps until the next SysTick and lets
+  the run loop check the timed jobs again every millisecond. Here the core
+  sleeps through to the next timed job, or to the next interrupt when
+  there is none, so a year of uplinks takes seconds.
+*/
+
+#include <Arduino.h>
+#include <lmic.h>
+
+void hal_sleep()
+{
+  ostime_t deadline;
+  if (os_getNextJob(&deadline) == NULL) {
+    sim_wakeup_in(UINT32_MAX);
+  } else {
+    ostime_t delta = deadline - os_getTime();
+    if (delta > 0)
+      sim_wakeup_in(osticks2us(delta));
+  }
+  // like hal_idle(), an interrupt that fires before the WFI wakes it up
+  __disable_irq();
+  __WFI();
+  __enable_irq();
+}
@@ -0,0 +1,101 @@
+/*
+  sim_main.cpp
+  main() of the native firmware build: setup() and then loop() until the
+  given virtual time has passed, starting over after every shutdown().
+  Sleeping jumps the virtual clock, so a year of uplinks takes seconds.
+  Prints what the run did and cost at the end, see sim_report.h.
+
+  usage: program [-m meter] [-n noise] [-t truncate] [-q] [time]
+
+    time        virtual time to run in seconds, or e.g. 12h, 30d, 1y;
+                default one hour
+    -m meter    SML meter on Serial2: basic, full, slow or none
+    -n noise    bit errors per million bytes from the meter
+    -t truncate percentage of telegrams cut short
+    -q          drop the serial output of the firmware (stderr)
+*/
+
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include <STM32LowPower.h>
+#include <chrono>
+#include <unistd.h>
+#include "sim_radio.h"
+#include "sim_meter.h"
+#include "sim_report.h"
+
+extern HardwareSerial Serial2;
+
+void setup();
+void loop();
+
+// Run length: seconds, or with a unit m, h, d or y
+static double parseDuration(const char *arg)
+{
+  char *unit;
+  double v = strtod(arg, &unit);
+  switch (*unit) {
+  case 'm': return v * 60;
+  case 'h': return v * 3600;
+  case 'd': return v * 86400;
+  case 'y': return v * 365 * 86400;
+  }
+  return v;
+}
+
+int main(int argc, char **argv)
+{
+  SimMeterConfig meter = *simMeterFind("basic");
+  bool useMeter = true;
+  int opt;
+  while ((opt = getopt(argc, argv, "m:n:t:q")) != -1) {
+    switch (opt) {
+    case 'm':
+      useMeter = strcmp(optarg, "none") != 0;
+      if (useMeter) {
+        const SimMeterConfig *m = simMeterFind(optarg);
+        if (!m) {
+          fprintf(stderr, "unknown meter %s\n", optarg);
+          return 1;
+        }
+        meter = *m;
+      }
+      break;
+    case 'n':
+      meter.noisePpm = atoi(optarg);
+      break;
+    case 't':
+      meter.truncatePct = atoi(optarg);
+      break;
+    case 'q':
+      sim_uart_out = NULL;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-m meter] [-n noise] [-t truncate] [-q] [time]\n", argv[0]);
+      return 1;
+    }
+  }
+  uint64_t end = (uint64_t)((optind < argc ? parseDuration(argv[optind]) : 3600) * 1e6);
+  // a line per character slows down long runs
+  setvbuf(stderr, NULL, _IOFBF, 1 << 16);
+  simRadioAttach();
+  if (useMeter)
+    simMeterAttach(Serial2, meter);
+  auto start = std::chrono::steady_clock::now();
+
+  // shutdown() comes back here, like a reset
+  setjmp(sim_reset_point);
+  sim_reset_armed = true;
+  if (sim.us < end) {
+    setup();
+    while (sim.us < end)
+      loop();
+  }
+  sim_reset_armed = false;
+  std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+  simReportPrint(stdout, wall.count());
+  return 0;
+}
+
+#endif // PIO_UNIT_TESTING
@@ -0,0 +1,336 @@
+/*
+  sim_meter.cpp
+  SML meter model, see sim_meter.h
+*/
+
+#include <STM32LowPower.h>
+#include "sim_meter.h"
+
+#define OBIS_WH(c, d, e, start, perHour) \
+  { {1, 0, c, d, e, 0xFF}, 30, -1, start, perHour, 0 }
+#define OBIS_W(c, d, e, start, jitter) \
+  { {1, 0, c, d, e, 0xFF}, 27, 0, start, 0, jitter }
+
+// Energy in 0.1 Wh, about 3500 kWh a year in T1
+static const SimObis basicObis[] = {
+  OBIS_WH(1, 8, 0, 123456780, 4000),  // 1-0:1.8.0 import
+  OBIS_WH(1, 8, 1, 100000000, 4000),  // 1-0:1.8.1 import T1
+};
+
+static const SimObis fullObis[] = {
+  OBIS_WH(1, 8, 0, 123456780, 4000),  // 1-0:1.8.0 import
+  OBIS_WH(1, 8, 1, 100000000, 4000),  // 1-0:1.8.1 import T1
+  OBIS_WH(1, 8, 2, 23456780, 0),      // 1-0:1.8.2 import T2
+  OBIS_WH(2, 8, 0, 5000000, 1000),    // 1-0:2.8.0 export
+  OBIS_W(16, 7, 0, 400, 300),         // 1-0:16.7.0 power
+  OBIS_W(36, 7, 0, 150, 100),         // 1-0:36.7.0 power L1
+  OBIS_W(56, 7, 0, 150, 100),         // 1-0:56.7.0 power L2
+  OBIS_W(76, 7, 0, 100, 100),         // 1-0:76.7.0 power L3
+};
+
+#define COUNT(a) (uint8_t)(sizeof(a) / sizeof((a)[0]))
+
+const SimMeterConfig simMeterTypes[] = {
+  {"basic", basicObis, COUNT(basicObis), 1000, 9600, 0, 0},
+  {"full", fullObis, COUNT(fullObis), 1000, 9600, 0, 0},
+  {"slow", basicObis, COUNT(basicObis), 4000, 9600, 0, 0},
+  {NULL, NULL, 0, 0, 0, 0, 0},
+};
+
+const SimMeterConfig *simMeterFind(const char *name)
+{
+  for (const SimMeterConfig *c = simMeterTypes; c->name; c++)
+    if (strcmp(c->name, name) == 0)
+      return c;
+  return NULL;
+}
+
+SimMeterStats simMeter;
+
+// Own generator, so the meter does not change what rand() gives the
+// firmware and the radio
+static uint32_t rng = 0x2545F491;
+
+static uint32_t random32()
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+// CRC-16/X-25 as used by SML
+static uint16_t crc16(const uint8_t *p, size_t n)
+{
+  static uint16_t table[256];
+  if (!table[1]) {
+    for (int b = 0; b < 256; b++) {
+      uint16_t c = b;
+      for (int i = 0; i < 8; i++)
+        c = (c & 1) ? (c >> 1) ^ 0x8408 : c >> 1;
+      table[b] = c;
+    }
+  }
+  uint16_t crc = 0xFFFF;
+  while (n--)
+    crc = (crc >> 8) ^ table[(crc ^ *p++) & 0xFF];
+  return crc ^ 0xFFFF;
+}
+
+// ---------------------------------------------------------------------------
+// Telegram
+
+struct Writer {
+  uint8_t *buf;
+  size_t size;
+  size_t pos;
+
+  void byte(uint8_t b) {
+    if (pos < size)
+      buf[pos] = b;
+    pos++;
+  }
+  // Type-length field and big endian value
+  void number(uint8_t type, uint64_t v, int n) {
+    byte(type | (n + 1));
+    while (n--)
+      byte(v >> (8 * n));
+  }
+  void octets(const uint8_t *p, int n) {
+    byte(n + 1);
+    while (n--)
+      byte(*p++);
+  }
+  void list(int n) { byte(0x70 | n); }
+  void empty() { byte(0x01); }
+  // CRC of the message since start, low byte first like the file CRC
+  void crc(size_t start) {
+    uint16_t c = pos <= size ? crc16(buf + start, pos - start) : 0;
+    byte(0x63);
+    byte(c);
+    byte(c >> 8);
+  }
+};
+
+static const uint8_t serverId[10] = {0x0A, 0x01, 0x53, 0x49, 0x4D, 0x00, 0x00, 0x12, 0x34, 0x56};
+static const uint8_t listName[6] = {0x01, 0x00, 0x62, 0x0A, 0xFF, 0xFF};
+
+// Message header: transaction id, group, abort on error, body choice
+static size_t messageStart(Writer &w, uint32_t file, uint8_t n, uint16_t tag)
+{
+  size_t start = w.pos;
+  uint8_t tid[6] = {0x00, (uint8_t)(file >> 24), (uint8_t)(file >> 16), (uint8_t)(file >> 8), (uint8_t)file, n};
+  w.list(6);
+  w.octets(tid, sizeof(tid));
+  w.number(0x60, 0, 1);
+  w.number(0x60, 0, 1);
+  w.list(2);
+  w.number(0x60, tag, 2);
+  return start;
+}
+
+static void messageEnd(Writer &w, size_t start)
+{
+  w.crc(start);
+  w.byte(0x00);
+}
+
+size_t simMeterTelegram(const SimMeterConfig &config, uint64_t us, uint8_t *buf, size_t size)
+{
+  Writer w = {buf, size, 0};
+  uint32_t secs = us / 1000000;
+  uint32_t file = us / 1000 / config.periodMs;
+  size_t m;
+
+  for (int i = 0; i < 4; i++)
+    w.byte(0x1B);
+  for (int i = 0; i < 4; i++)
+    w.byte(0x01);
+
+  // PublicOpen.Res
+  m = messageStart(w, file, 0, 0x0101);
+  w.list(6);
+  w.empty();                                // codepage
+  w.empty();                                // client id
+  uint8_t reqFileId[6] = {0, 0, (uint8_t)(file >> 24), (uint8_t)(file >> 16), (uint8_t)(file >> 8), (uint8_t)file};
+  w.octets(reqFileId, sizeof(reqFileId));
+  w.octets(serverId, sizeof(serverId));
+  w.empty();                                // ref time
+  w.empty();                                // SML version
+  messageEnd(w, m);
+
+  // GetList.Res
+  m = messageStart(w, file, 1, 0x0701);
+  w.list(7);
+  w.empty();                                // client id
+  w.octets(serverId, sizeof(serverId));
+  w.octets(listName, sizeof(listName));
+  w.list(2);                                // act sensor time
+  w.number(0x60, 1, 1);
+  w.number(0x60, secs, 4);
+  w.list(config.numObis);
+  for (int i = 0; i < config.numObis; i++) {
+    const SimObis &o = config.obis[i];
+    int64_t v = o.start + o.perHour * (int64_t)us / 3600000000LL;
+    if (o.jitter)
+      v += (int32_t)(random32() % (2 * o.jitter + 1)) - o.jitter;
+    w.list(7);
+    w.octets(o.code, 6);
+    w.number(0x60, 0x00010104, 4);          // status
+    w.empty();                              // value time
+    w.number(0x60, o.unit, 1);
+    w.number(0x50, (uint8_t)o.scaler, 1);
+    if (o.unit == 30)
+      w.number(0x50, v, 8);
+    else
+      w.number(0x50, v, 4);
+    w.empty();                              // value signature
+  }
+  w.empty();                                // list signature
+  w.empty();                                // act gateway time
+  messageEnd(w, m);
+
+  // PublicClose.Res
+  m = messageStart(w, file, 2, 0x0201);
+  w.list(1);
+  w.empty();                                // global signature
+  messageEnd(w, m);
+
+  // pad to a multiple of 4, end escape, CRC over everything before
+  uint8_t pad = (4 - w.pos % 4) % 4;
+  for (int i = 0; i < pad; i++)
+    w.byte(0x00);
+  for (int i = 0; i < 4; i++)
+    w.byte(0x1B);
+  w.byte(0x1A);
+  w.byte(pad);
+  uint16_t crc = w.pos <= size ? crc16(buf, w.pos) : 0;
+  w.byte(crc);
+  w.byte(crc >> 8);
+  return w.pos;
+}
+
+// ---------------------------------------------------------------------------
+// Wire
+
+static HardwareSerial *meterPort;
+static const SimMeterConfig *meter;
+static uint64_t phaseUs;     // start of telegram 0
+static uint64_t periodUs;
+static uint32_t upcoming;    // number of the next telegram
+static uint8_t telegram[1024]; // the one before, on the wire
+static size_t length;        // bytes of it that are sent
+static size_t sent;          // bytes of it already on the wire
+static uint64_t openedAt;    // port.openSince of the current opening
+static uint64_t deafUntil;   // bytes that arrived before are lost
+static uint64_t lastPoll;
+
+// Polls further apart belong to separate reads
+#define READ_GAP_US 1000000
+
+// Arrival of byte j of telegram k, after its stop bit
+static uint64_t arrival(uint32_t k, size_t j)
+{
+  return phaseUs + k * periodUs + (uint64_t)(j + 1) * 10000000 / meter->baud;
+}
+
+static void startTelegram()
+{
+  sent = 0;
+  length = simMeterTelegram(*meter, phaseUs + upcoming * periodUs, telegram, sizeof(telegram));
+  if (length > sizeof(telegram))
+    length = sizeof(telegram);
+  upcoming++;
+  simMeter.telegrams++;
+  if (meter->truncatePct && random32() % 100 < meter->truncatePct) {
+    length = 1 + random32() % (length - 1);
+    simMeter.truncated++;
+  }
+}
+
+// The port receives nothing before t: skip the telegrams that were sent
+// completely before, and the bytes before t of the one on the wire then
+static void deafTo(uint64_t t)
+{
+  deafUntil = t;
+  uint32_t first = t > phaseUs ? (t - phaseUs) / periodUs : 0;
+  if (first >= upcoming) {
+    upcoming = first;
+    length = sent = 0;
+  }
+}
+
+// Put the bytes that arrived by now into the RX buffer, false if the port
+// is closed
+static bool feed(HardwareSerial &port)
+{
+  uint64_t now = sim.us;
+  // a closed port, or opened before the last reset
+  if (!port.open || port.openSince < sim.bootUs)
+    return false;
+
+  if (port.openSince != openedAt) {
+    openedAt = port.openSince;
+    simMeter.opens++;
+    deafTo(openedAt);
+  }
+
+  for (;;) {
+    if (sent >= length) {
+      if (phaseUs + upcoming * periodUs > now)
+        return true;
+      startTelegram();
+    }
+    uint64_t at = arrival(upcoming - 1, sent);
+    if (at > now)
+      return true;
+    uint8_t c = telegram[sent++];
+    if (at < deafUntil)
+      continue;
+    if (meter->noisePpm && random32() % 1000000 < meter->noisePpm) {
+      c ^= 1 << (random32() % 8);
+      simMeter.flipped++;
+    }
+    if (port.receive(c))
+      simMeter.received++;
+    else
+      simMeter.overruns++;
+  }
+}
+
+static void poll(HardwareSerial &port)
+{
+  if (&port != meterPort || !feed(port))
+    return;
+  uint64_t now = sim.us;
+  if (simMeter.reads == 0 || now - lastPoll > READ_GAP_US)
+    simMeter.reads++;
+  else
+    simMeter.pollUs += now - lastPoll;
+  lastPoll = now;
+}
+
+// In stop mode the USART has no clock: what came before is in the RX
+// buffer, what comes until the wakeup is lost
+static void stopped(bool enter)
+{
+  if (enter)
+    feed(*meterPort);
+  else
+    deafTo(sim.us);
+}
+
+void simMeterAttach(HardwareSerial &port, const SimMeterConfig &config)
+{
+  meterPort = &port;
+  meter = &config;
+  periodUs = (uint64_t)config.periodMs * 1000;
+  phaseUs = sim.us + random32() % periodUs;
+  upcoming = 0;
+  length = sent = 0;
+  openedAt = UINT64_MAX;
+  deafUntil = 0;
+  simMeter = SimMeterStats();
+  sim_uart_poll = poll;
+  sim_stop_hook = stopped;
+}
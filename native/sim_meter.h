@@ -0,0 +1,71 @@
+/*
+  sim_meter.h
+  Electricity meter on the optical SML interface for the native firmware
+  build. It pushes an SML file (PublicOpen, GetList with the configured
+  OBIS values, PublicClose, X.25 checksums) every push period and feeds
+  the bytes into a simulated serial port at the time they would arrive
+  on the wire, 10 bit times per byte.
+
+  The meter runs on its own, so the firmware mostly starts listening in
+  the middle of a telegram. Bytes that arrive before the port is opened
+  after a reset are lost, as are those that arrive while the core is in
+  stop mode (the USART has no clock) and those that do not fit the RX
+  buffer. Line noise flips single bits, truncation stops a telegram at a
+  random point.
+*/
+#ifndef _sim_meter_h_
+#define _sim_meter_h_
+
+#include <Arduino.h>
+
+// One value of the GetList response: value = start + perHour * hours,
+// plus a random step of up to +-jitter per telegram
+struct SimObis {
+  uint8_t code[6];   // OBIS code, e.g. 1-0:1.8.1*255
+  uint8_t unit;      // DLMS unit (30 = Wh, 27 = W)
+  int8_t scaler;     // value * 10^scaler
+  int64_t start;
+  int64_t perHour;
+  int32_t jitter;
+};
+
+struct SimMeterConfig {
+  const char *name;
+  const SimObis *obis;
+  uint8_t numObis;
+  uint32_t periodMs;     // push period
+  uint32_t baud;
+  uint32_t noisePpm;     // chance per byte of a flipped bit, in 1e-6
+  uint8_t truncatePct;   // chance per telegram to stop early, in %
+};
+
+// Telegrams sent entirely while the port was closed or the core was in
+// stop mode (USART without clock) are skipped and not counted. Polls less
+// than a second apart belong to the same read of the firmware.
+struct SimMeterStats {
+  uint32_t telegrams;    // telegrams sent
+  uint32_t truncated;    // of those cut short
+  uint32_t flipped;      // bytes with a flipped bit
+  uint32_t received;     // bytes that made it into the RX buffer
+  uint32_t overruns;     // bytes dropped with a full RX buffer
+  uint32_t opens;        // times the port was opened (resets)
+  uint32_t reads;        // reads of the firmware
+  uint64_t pollUs;       // time from the first to the last poll, all reads
+};
+
+extern SimMeterStats simMeter;
+
+// Meter types, terminated by a config with name NULL
+extern const SimMeterConfig simMeterTypes[];
+
+// Find a meter type by name, NULL if there is none
+const SimMeterConfig *simMeterFind(const char *name);
+
+// Connect the meter to the port, it starts pushing at a random phase
+void simMeterAttach(HardwareSerial &port, const SimMeterConfig &config);
+
+// Build the telegram the meter sends at virtual time us, without noise
+// or truncation. Returns its length.
+size_t simMeterTelegram(const SimMeterConfig &config, uint64_t us, uint8_t *buf, size_t size);
+
+#endif // _sim_meter_h_
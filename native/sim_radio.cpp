@@ -0,0 +1,213 @@
+/*
+  sim_radio.cpp
+  SX1276 model, see sim_radio.h
+*/
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include "sim_radio.h"
+#include "sim_report.h"
+
+#define REG_FIFO           0x00
+#define REG_OPMODE         0x01
+#define REG_FRF_MSB        0x06
+#define REG_PA_CONFIG      0x09
+#define REG_FIFO_ADDR      0x0D
+#define REG_FIFO_TX_BASE   0x0E
+#define REG_IRQ_FLAGS      0x12
+#define REG_MODEM_CONFIG1  0x1D
+#define REG_MODEM_CONFIG2  0x1E
+#define REG_SYMB_TIMEOUT   0x1F
+#define REG_PAYLOAD_LENGTH 0x22
+#define REG_RSSI_WIDEBAND  0x2C
+#define REG_VERSION        0x42
+
+#define OPMODE_LORA      0x80
+#define OPMODE_MASK      0x07
+#define OPMODE_STANDBY   0x01
+#define OPMODE_FSTX      0x02
+#define OPMODE_TX        0x03
+#define OPMODE_RX_SINGLE 0x06
+
+#define IRQ_TX_DONE      0x08
+#define IRQ_RX_DONE      0x40
+#define IRQ_RX_TIMEOUT   0x80
+
+SimRadio simRadio;
+
+static int spiPos; // byte position in the current transaction
+static uint8_t spiAddr;
+
+static void reset()
+{
+  memset(simRadio.regs, 0, sizeof(simRadio.regs));
+  simRadio.regs[REG_OPMODE] = 0x09; // FSK standby
+  simRadio.regs[REG_VERSION] = 0x12;
+  simRadio.modeSince = sim.us;
+  simRadio.doneAt = 0;
+}
+
+// Airtime of the payload with the programmed modem config
+static uint32_t airtimeUs()
+{
+  uint8_t mc1 = simRadio.regs[REG_MODEM_CONFIG1];
+  uint8_t mc2 = simRadio.regs[REG_MODEM_CONFIG2];
+  uint8_t plen = simRadio.regs[REG_PAYLOAD_LENGTH];
+  rps_t rps = makeRps((sf_t)((mc2 >> 4) - 6),        // SF7 = 0x70
+                      (bw_t)((mc1 >> 4) - 7),        // BW125 = 0x70
+                      (cr_t)(((mc1 >> 1) & 7) - 1),  // CR4/5 = 0x02
+                      (mc1 & 1) ? plen : 0,          // implicit header
+                      (mc2 & 0x04) == 0);            // no CRC
+  return osticks2us(calcAirTime(rps, plen));
+}
+
+// Length of a single RX window without a preamble
+static uint32_t rxTimeoutUs()
+{
+  uint8_t mc1 = simRadio.regs[REG_MODEM_CONFIG1];
+  uint8_t mc2 = simRadio.regs[REG_MODEM_CONFIG2];
+  uint32_t symbols = (mc2 & 0x03) << 8 | simRadio.regs[REG_SYMB_TIMEOUT];
+  uint32_t bwHz = 125000 << ((mc1 >> 4) - 7);
+  return (uint64_t)symbols * (1000000ull << (mc2 >> 4)) / bwHz;
+}
+
+static void updateDio()
+{
+  uint8_t flags = simRadio.regs[REG_IRQ_FLAGS];
+  digitalWrite(lmic_pins.dio[0], (flags & (IRQ_TX_DONE | IRQ_RX_DONE)) != 0);
+  digitalWrite(lmic_pins.dio[1], (flags & IRQ_RX_TIMEOUT) != 0);
+}
+
+static uint32_t frequency()
+{
+  uint32_t frf = simRadio.regs[REG_FRF_MSB] << 16 | simRadio.regs[REG_FRF_MSB + 1] << 8 |
+                 simRadio.regs[REG_FRF_MSB + 2];
+  return (uint64_t)frf * 32000000 >> 19;
+}
+
+// Output power in dBm, PA_BOOST gives 2..17 dBm
+static int8_t power()
+{
+  uint8_t pac = simRadio.regs[REG_PA_CONFIG];
+  return (pac & 0x80 ? 2 : -1) + (pac & 0x0F);
+}
+
+// Add the time in the current mode up to now to the counters
+static void account(uint64_t now)
+{
+  uint8_t op = simRadio.regs[REG_OPMODE];
+  uint64_t dt = now - simRadio.modeSince;
+  simRadio.modeSince = now;
+  switch (op & OPMODE_MASK) {
+  case OPMODE_STANDBY:
+    simRadio.stbyUs += dt;
+    break;
+  case OPMODE_FSTX:
+  case OPMODE_TX:
+    simRadio.txUs += dt;
+    break;
+  case 0x04: // FSRX
+  case 0x05: // RX
+  case OPMODE_RX_SINGLE:
+  case 0x07: // CAD
+    simRadio.rxUs += dt;
+    break;
+  }
+}
+
+// Finish a TX or RX window whose time has come: set the flag and fall
+// back to standby like the chip does
+static void update()
+{
+  uint64_t at = simRadio.doneAt;
+  if (at == 0 || sim.us < at)
+    return;
+  account(at);
+  uint8_t op = simRadio.regs[REG_OPMODE];
+  simRadio.regs[REG_IRQ_FLAGS] |= (op & OPMODE_MASK) == OPMODE_TX ? IRQ_TX_DONE : IRQ_RX_TIMEOUT;
+  simRadio.regs[REG_OPMODE] = (op & ~OPMODE_MASK) | OPMODE_STANDBY;
+  simRadio.doneAt = 0;
+  if (sim.irqAt == at)
+    sim.irqAt = 0;
+  updateDio();
+}
+
+static void setOpMode(uint8_t val)
+{
+  update();
+  account(sim.us);
+  simRadio.regs[REG_OPMODE] = val;
+  simRadio.doneAt = 0;
+  if (!(val & OPMODE_LORA))
+    return;
+  switch (val & OPMODE_MASK) {
+  case OPMODE_TX:
+    simRadio.tx++;
+    simRadio.lastAirUs = airtimeUs();
+    simRadio.doneAt = sim.us + simRadio.lastAirUs;
+    simReportTx(frequency(), power(), simRadio.lastAirUs,
+                simRadio.fifo + simRadio.regs[REG_FIFO_TX_BASE], simRadio.regs[REG_PAYLOAD_LENGTH]);
+    break;
+  case OPMODE_RX_SINGLE:
+    simRadio.rx++;
+    simRadio.doneAt = sim.us + rxTimeoutUs();
+    break;
+  default:
+    return;
+  }
+  sim.irqAt = simRadio.doneAt;
+}
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == lmic_pins.nss && val == 0) {
+    update();
+    spiPos = 0;
+    simRadio.transactions++;
+  }
+  else if (pin == lmic_pins.rst && val == 0)
+    reset();
+}
+
+static void radioPinRead(uint32_t pin)
+{
+  if (pin == lmic_pins.dio[0] || pin == lmic_pins.dio[1])
+    update();
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    if (addr == REG_FIFO)
+      simRadio.fifo[simRadio.regs[REG_FIFO_ADDR]++] = out;
+    else if (addr == REG_OPMODE)
+      setOpMode(out);
+    else if (addr == REG_IRQ_FLAGS) {
+      simRadio.regs[REG_IRQ_FLAGS] &= ~out;
+      updateDio();
+    }
+    else
+      simRadio.regs[addr] = out;
+    return 0;
+  }
+  if (addr == REG_FIFO)
+    return simRadio.fifo[simRadio.regs[REG_FIFO_ADDR]++];
+  if (addr == REG_RSSI_WIDEBAND)
+    return rand();
+  return simRadio.regs[addr];
+}
+
+void simRadioAttach()
+{
+  reset();
+  sim_pin_write = radioPin;
+  sim_pin_read = radioPinRead;
+  sim_spi_transfer = radioSpi;
+}
@@ -0,0 +1,37 @@
+/*
+  sim_radio.h
+  SX1276 model for the native firmware build, behind hal_spi() and the
+  NSS/RST pins. It implements the registers radio.c uses: RegOpMode, the
+  FIFO and its pointers, the IRQ flags, RssiWideband (noise) and the LoRa
+  modem config. A TX raises TxDone on DIO0 after the airtime calcAirTime()
+  gives for the programmed SF, BW, CR, header mode and payload length. A
+  single RX window raises RxTimeout on DIO1 after RegSymbTimeout symbols,
+  there are no downlinks. The end of a TX or RX is also an external
+  interrupt (sim.irqAt), so it wakes the core from WFI and low power modes.
+  Only LoRa mode is modelled. Every frame is passed to simReportTx().
+*/
+#ifndef _sim_radio_h_
+#define _sim_radio_h_
+
+#include <stdint.h>
+
+struct SimRadio {
+  uint8_t regs[0x80];
+  uint8_t fifo[256];
+  uint64_t modeSince;    // virtual time RegOpMode was last set
+  uint64_t doneAt;       // end of the running TX or RX window (0 = none)
+  uint32_t tx;           // frames sent
+  uint32_t rx;           // RX windows opened
+  uint32_t transactions; // SPI transactions (NSS low)
+  uint64_t txUs;         // time in TX (incl. FSTX)
+  uint64_t rxUs;         // time in RX, RX single and CAD (incl. FSRX)
+  uint64_t stbyUs;       // time in standby
+  uint32_t lastAirUs;    // airtime of the last frame
+};
+
+extern SimRadio simRadio;
+
+// Hook the radio into the simulated SPI and pins
+void simRadioAttach();
+
+#endif // _sim_radio_h_
@@ -0,0 +1,217 @@
+/*
+  sim_report.cpp
+  Run report of the native build, see sim_report.h
+*/
+
+#include <Arduino.h>
+#include <deque>
+#include "sim_radio.h"
+#include "sim_meter.h"
+#include "sim_report.h"
+
+#define HOUR_US 3600000000ULL
+
+// ---------------------------------------------------------------------------
+// Duty cycle, ETSI EN 300 220 sub-bands in the EU868 range
+
+struct Burst {
+  uint64_t end;
+  uint32_t airUs;
+};
+
+struct SubBand {
+  const char *name;
+  uint32_t lo, hi;       // Hz
+  uint16_t permille;     // duty cycle limit
+  uint32_t frames;
+  uint64_t airUs;
+  uint64_t hourUs;       // airtime in the hour up to the last frame
+  uint64_t maxHourUs;    // most airtime in any hour
+  std::deque<Burst> hour;
+};
+
+static SubBand subBands[] = {
+  {"863.0-868.0", 863000000, 868000000, 10},
+  {"868.0-868.6", 868000000, 868600000, 10},
+  {"868.7-869.2", 868700000, 869200000, 1},
+  {"869.4-869.65", 869400000, 869650000, 100},
+  {"869.7-870.0", 869700000, 870000000, 10},
+};
+
+static uint32_t outOfBand;
+
+static void dutyCycle(uint32_t freq, uint32_t airUs)
+{
+  for (SubBand &b : subBands) {
+    if (freq < b.lo || freq > b.hi)
+      continue;
+    uint64_t end = sim.us + airUs;
+    b.frames++;
+    b.airUs += airUs;
+    b.hour.push_back({end, airUs});
+    b.hourUs += airUs;
+    // frames that ended an hour or more before this one ends
+    while (b.hour.front().end + HOUR_US <= end) {
+      b.hourUs -= b.hour.front().airUs;
+      b.hour.pop_front();
+    }
+    if (b.hourUs > b.maxHourUs)
+      b.maxHourUs = b.hourUs;
+    return;
+  }
+  outOfBand++;
+}
+
+// ---------------------------------------------------------------------------
+// Frame counters of data uplinks
+
+static struct {
+  uint32_t joins;        // join requests
+  uint32_t frames;       // data uplinks
+  uint16_t first, last;
+  uint32_t repeated;     // same FCnt as the frame before
+  uint32_t skipped;      // FCnts left out
+  uint32_t back;         // FCnt went backwards (session lost)
+} fcnt;
+
+static void frameCounter(const uint8_t *frame, uint8_t len)
+{
+  uint8_t mtype = frame[0] >> 5;
+  if (mtype == 0) {
+    fcnt.joins++;
+    return;
+  }
+  if ((mtype != 2 && mtype != 4) || len < 8)
+    return;
+  uint16_t n = frame[6] | frame[7] << 8;
+  if (fcnt.frames++ == 0)
+    fcnt.first = n;
+  else {
+    uint16_t delta = n - fcnt.last;
+    if (delta == 0)
+      fcnt.repeated++;
+    else if (delta >= 0x8000)
+      fcnt.back++;
+    else
+      fcnt.skipped += delta - 1;
+  }
+  fcnt.last = n;
+}
+
+// ---------------------------------------------------------------------------
+// Charge, typical currents from the STM32L051 and SX1276 datasheets at 3 V.
+// Round numbers: measure the board for anything better than a comparison.
+
+#define MCU_RUN_UA      6500.0  // 32 MHz from flash
+#define MCU_SLEEP_UA    1500.0  // WFI, clocks running
+#define MCU_STOP_UA     1.5     // RTC running
+#define MCU_STANDBY_UA  0.9     // RTC running
+#define RADIO_SLEEP_UA  0.2
+#define RADIO_STBY_UA   1600.0
+#define RADIO_RX_UA     11500.0
+
+static double txCharge;         // uAs
+
+// TX current on PA_BOOST, interpolated
+static double txUa(int8_t dbm)
+{
+  static const struct { int8_t dbm; uint16_t mA; } pa[] = {
+    {2, 24}, {10, 32}, {14, 44}, {17, 87},
+  };
+  if (dbm <= pa[0].dbm)
+    return pa[0].mA * 1000.0;
+  for (unsigned i = 1; i < sizeof(pa) / sizeof(pa[0]); i++) {
+    if (dbm <= pa[i].dbm)
+      return 1000.0 * (pa[i - 1].mA + (double)(pa[i].mA - pa[i - 1].mA) *
+                       (dbm - pa[i - 1].dbm) / (pa[i].dbm - pa[i - 1].dbm));
+  }
+  return 120000.0; // 20 dBm
+}
+
+// ---------------------------------------------------------------------------
+
+void simReportTx(uint32_t freq, int8_t dbm, uint32_t airUs, const uint8_t *frame, uint8_t len)
+{
+  dutyCycle(freq, airUs);
+  if (len)
+    frameCounter(frame, len);
+  txCharge += txUa(dbm) * airUs / 1e6;
+}
+
+static void printTime(FILE *out, const char *what, double s)
+{
+  if (s >= 2 * 86400)
+    fprintf(out, "%-18s%10.1f d\n", what, s / 86400);
+  else
+    fprintf(out, "%-18s%10.1f s\n", what, s);
+}
+
+void simReportPrint(FILE *out, double wall)
+{
+  double s = sim.us / 1e6;
+  double sleep = sim.sleptUs / 1e6;
+  double standby = sim.standbyUs / 1e6;
+  double stop = (sim.lowPowerUs - sim.standbyUs) / 1e6;
+  double run = s - sleep - stop - standby;
+
+  printTime(out, "virtual time", s);
+  fprintf(out, "awake             %10.1f s (%.2f%%)\n", run, 100 * run / s);
+  fprintf(out, "stop / standby    %10u / %u\n", sim.stops, sim.shutdowns);
+  fprintf(out, "EEPROM words      %10u\n", sim_eeprom.writes);
+
+  fprintf(out, "uplinks           %10u (%.1f per day)\n", simRadio.tx, simRadio.tx * 86400.0 / s);
+  fprintf(out, "RX windows        %10u\n", simRadio.rx);
+  if (simRadio.tx) {
+    fprintf(out, "per uplink:\n");
+    fprintf(out, "  SPI transactions  %8.1f\n", (double)simRadio.transactions / simRadio.tx);
+    fprintf(out, "  TX on             %8.1f ms\n", simRadio.txUs / 1e3 / simRadio.tx);
+    fprintf(out, "  RX on             %8.1f ms\n", simRadio.rxUs / 1e3 / simRadio.tx);
+    fprintf(out, "  last airtime      %8.1f ms\n", simRadio.lastAirUs / 1e3);
+  }
+
+  fprintf(out, "duty cycle, most airtime in any hour:\n");
+  for (const SubBand &b : subBands) {
+    if (!b.frames)
+      continue;
+    double limit = b.permille * 3.6;
+    fprintf(out, "  %-12s MHz %6u frames %8.1f s of %6.1f s %s\n", b.name, b.frames,
+            b.maxHourUs / 1e6, limit, b.maxHourUs / 1e6 <= limit ? "ok" : "EXCEEDED");
+  }
+  if (outOfBand)
+    fprintf(out, "  %u frames outside the EU868 sub-bands\n", outOfBand);
+
+  if (fcnt.frames || fcnt.joins) {
+    fprintf(out, "frame counters:\n");
+    if (fcnt.joins)
+      fprintf(out, "  join requests     %8u\n", fcnt.joins);
+    fprintf(out, "  FCnt              %8u .. %u\n", fcnt.first, fcnt.last);
+    fprintf(out, "  repeated          %8u\n", fcnt.repeated);
+    fprintf(out, "  skipped           %8u\n", fcnt.skipped);
+    fprintf(out, "  went back         %8u\n", fcnt.back);
+  }
+
+  if (sim_uart_poll) {
+    fprintf(out, "meter:\n");
+    fprintf(out, "  telegrams         %8u (%u truncated)\n", simMeter.telegrams, simMeter.truncated);
+    fprintf(out, "  bytes received    %8u (%u with bit errors, %u overruns)\n",
+            simMeter.received, simMeter.flipped, simMeter.overruns);
+    if (simMeter.reads)
+      fprintf(out, "  polling per read  %8.1f ms (%u reads)\n", simMeter.pollUs / 1e3 / simMeter.reads,
+              simMeter.reads);
+  }
+
+  // charge in uAs
+  double radioSleep = s - (simRadio.txUs + simRadio.rxUs + simRadio.stbyUs) / 1e6;
+  double mcu = run * MCU_RUN_UA + sleep * MCU_SLEEP_UA + stop * MCU_STOP_UA + standby * MCU_STANDBY_UA;
+  double radio = txCharge + simRadio.rxUs / 1e6 * RADIO_RX_UA +
+                 simRadio.stbyUs / 1e6 * RADIO_STBY_UA + radioSleep * RADIO_SLEEP_UA;
+  fprintf(out, "charge (model):\n");
+  fprintf(out, "  MCU               %8.3f mAh\n", mcu / 3.6e6);
+  fprintf(out, "  radio             %8.3f mAh (TX %.3f)\n", radio / 3.6e6, txCharge / 3.6e6);
+  if (simRadio.tx)
+    fprintf(out, "  per uplink        %8.1f uAh\n", (mcu + radio) / 3.6e3 / simRadio.tx);
+  fprintf(out, "  average current   %8.2f uA\n", (mcu + radio) / s);
+  fprintf(out, "  days per 1000 mAh %8.0f\n", 1000 * 3.6e6 / ((mcu + radio) / s) / 86400);
+
+  fprintf(out, "host time         %10.3f s\n", wall);
+}
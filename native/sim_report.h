@@ -0,0 +1,20 @@
+/*
+  sim_report.h
+  What a native run did, for comparing schedules before flashing nodes:
+  uplinks, airtime and duty cycle per EU868 sub-band (the maximum in any
+  hour against the ETSI limit), frame counters as they went out, and the
+  charge drawn by the MCU and the radio after a simple current model.
+*/
+#ifndef _sim_report_h_
+#define _sim_report_h_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// A frame starts to go out (called by the radio model)
+void simReportTx(uint32_t freq, int8_t dbm, uint32_t airUs, const uint8_t *frame, uint8_t len);
+
+// Print the report, wall is the host time the run took
+void simReportPrint(FILE *out, double wall);
+
+#endif // _sim_report_h_
@@ -0,0 +1,41 @@
+/*
+  sim_stm32.h
+  The few STM32L0 HAL definitions the firmware uses directly: the standby
+  flag and the data EEPROM, which is a plain array here.
+*/
+#ifndef _sim_stm32_h_
+#define _sim_stm32_h_
+
+#include <stdint.h>
+
+typedef enum { HAL_OK = 0, HAL_ERROR } HAL_StatusTypeDef;
+
+#define RESET 0
+#define SET   1
+
+#define PWR_FLAG_WU 0
+#define PWR_FLAG_SB 1
+#define __HAL_PWR_GET_FLAG(flag) ((flag) == PWR_FLAG_SB ? sim.standby : RESET)
+#define __HAL_PWR_CLEAR_FLAG(flag) ((flag) == PWR_FLAG_SB ? (void)(sim.standby = 0) : (void)0)
+
+// 2 KB data EEPROM of the STM32L051, erased
+struct SimEeprom {
+  alignas(4) uint8_t mem[2048];
+  uint32_t writes; // words programmed
+};
+inline SimEeprom sim_eeprom = {{0}, 0};
+
+#define DATA_EEPROM_BASE ((uintptr_t)sim_eeprom.mem)
+#define DATA_EEPROM_END  (DATA_EEPROM_BASE + sizeof(sim_eeprom.mem) - 1)
+
+#define FLASH_TYPEPROGRAMDATA_WORD 2
+
+inline HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Unlock() { return HAL_OK; }
+inline HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Lock() { return HAL_OK; }
+inline HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Program(uint32_t type, uintptr_t address, uint32_t data) {
+  *(volatile uint32_t *)address = data;
+  sim_eeprom.writes++;
+  return HAL_OK;
+}
+
+#endif // _sim_stm32_h_
@@ -0,0 +1,154 @@
+/*
+  link_adapt.cpp
+  Data rate and transmit power from the link quality, see link_adapt.h
+*/
+
+#include <lmic.h>
+#include "link_adapt.h"
+
+// A link check request goes with every LINK_CHECK_EVERY-th uplink
+#define LINK_CHECK_EVERY 8
+
+// Margin above the demodulation floor kept for fading, in dB
+#define INSTALL_MARGIN 10
+// One DR step is worth about 2.5 dB, one power step 2 dB, both count as
+// STEP_DB of margin
+#define STEP_DB 3
+// Stepping up needs this much more margin, in UP_CONFIRM answers in a row
+#define UP_HYSTERESIS 3
+#define UP_CONFIRM 2
+// Link checks in a row without any answer before falling back one step
+#define FALLBACK_MISSED 2
+
+#define MAX_TXPOW 14
+#define MIN_TXPOW 2
+
+// Airtime allowed per uplink, in 1/1000 of the uplink interval. The duty
+// cycle limit of the default channels is 1%, the TTN fair use policy
+// (30 s a day) is about 0.35/1000.
+#define AIRTIME_BUDGET_PERMILLE 10
+
+// LoRaWAN header, FPort and MIC of a data frame
+#define FRAME_OVERHEAD 13
+
+static struct {
+  uint8_t checkIn;  // uplinks until the next link check request
+  uint8_t missed;   // link checks in a row without an answer
+  uint8_t good;     // answers in a row with room to step up
+  uint8_t pending;  // the last uplink had a link check request
+} state;
+
+// Slowest DR allowed by the airtime budget, worked out for each uplink
+static dr_t slowest = DR_SF12;
+
+// Lowest SNR the gateway can demodulate, in dB * 4 like LMIC.snr
+static int snrFloor(rps_t rps)
+{
+  // SF7 -7.5 dB, 2.5 dB less for each step up to SF12 -20 dB
+  return -20 - 10 * getSf(rps);
+}
+
+static dr_t budgetDr(uint8_t len, uint32_t interval)
+{
+  ostime_t budget = ms2osticks(interval / 1000 * AIRTIME_BUDGET_PERMILLE);
+  dr_t dr = DR_SF12;
+  while (dr < DR_SF7 && calcAirTime(updr2rps(dr), len) > budget)
+    dr = incDR(dr);
+  return dr;
+}
+
+// Apply steps of STEP_DB: up is a faster DR first and then less power,
+// down is more power first and then a slower DR
+static void applySteps(int steps)
+{
+  dr_t dr = LMIC.datarate;
+  s1_t pow = LMIC.adrTxPow;
+  for (; steps > 0; steps--) {
+    if (dr < DR_SF7)
+      dr = incDR(dr);
+    else if (pow > MIN_TXPOW)
+      pow -= 2;
+  }
+  for (; steps < 0; steps++) {
+    if (pow < MAX_TXPOW)
+      pow = pow + 2 < MAX_TXPOW ? pow + 2 : MAX_TXPOW;
+    else if (dr > slowest)
+      dr = decDR(dr);
+  }
+  if (dr != LMIC.datarate || pow != LMIC.adrTxPow)
+    LMIC_setDrTxpow(dr, pow);
+}
+
+static void adapt(int margin)
+{
+  int excess = margin - INSTALL_MARGIN;
+  if (excess < 0) {
+    state.good = 0;
+    applySteps(-((-excess + STEP_DB - 1) / STEP_DB));
+  } else if (excess >= STEP_DB + UP_HYSTERESIS) {
+    if (++state.good < UP_CONFIRM)
+      return;
+    state.good = 0;
+    applySteps((excess - UP_HYSTERESIS) / STEP_DB);
+  } else {
+    state.good = 0;
+  }
+}
+
+void linkAdaptTx(uint8_t plen, uint32_t interval)
+{
+  uint8_t len = FRAME_OVERHEAD + plen;
+  if (state.checkIn == 0) {
+    LMIC_requestLinkCheck();
+    state.checkIn = LINK_CHECK_EVERY;
+    state.pending = 1;
+    len++;
+  }
+  state.checkIn--;
+
+  slowest = budgetDr(len, interval);
+  if (LMIC.datarate < slowest)
+    LMIC_setDrTxpow(slowest, KEEP_TXPOW);
+}
+
+void linkAdaptTxComplete()
+{
+  bool check = state.pending;
+  state.pending = 0;
+
+  if (check && LMIC.lchkGws != 0 && LMIC.lchkMargin != 255) {
+    state.missed = 0;
+    adapt(LMIC.lchkMargin);
+  } else if (LMIC.txrxFlags & (TXRX_DNW1 | TXRX_DNW2)) {
+    // the downlink came from a gateway with more power, so this is on the
+    // optimistic side, stepping up still needs several answers
+    state.missed = 0;
+    adapt((LMIC.snr - snrFloor(LMIC.rps)) / 4);
+  } else if (check) {
+    // maybe not heard by any gateway: check again right with the next
+    // uplink, unless there is nothing left to fall back to
+    if (LMIC.datarate > slowest || LMIC.adrTxPow < MAX_TXPOW)
+      state.checkIn = 0;
+    state.good = 0;
+    if (++state.missed >= FALLBACK_MISSED) {
+      state.missed = 0;
+      applySteps(-1);
+    }
+  }
+}
+
+uint32_t linkAdaptState()
+{
+  return state.checkIn | (state.missed << 8) | (state.good << 16) | ((uint32_t)state.pending << 24);
+}
+
+void linkAdaptSetState(uint32_t s)
+{
+  state.checkIn = s;
+  state.missed = s >> 8;
+  state.good = s >> 16;
+  state.pending = s >> 24;
+  // out of range after a change of the constants, start over
+  if (state.checkIn > LINK_CHECK_EVERY || state.missed >= FALLBACK_MISSED || state.good >= UP_CONFIRM)
+    state.checkIn = state.missed = state.good = 0;
+}
@@ -0,0 +1,31 @@
+/*
+  link_adapt.h
+  The node picks its own data rate and transmit power from the link quality,
+  as ADR is switched off. Every few uplinks carry a link check request, the
+  margin the gateways report (or the SNR of a downlink) steps the data rate
+  up and the power down when there is room, and the other way round when
+  the margin gets small. Without answers the node falls back step by step
+  towards full power and SF12.
+
+  Stepping up needs a margin well above the threshold in several answers in
+  a row, stepping down happens on the first bad one. The data rate never
+  goes slower than the airtime budget allows for the uplink interval.
+*/
+
+#ifndef LINK_ADAPT_H
+#define LINK_ADAPT_H
+
+#include <stdint.h>
+
+// Call before queueing an uplink of plen payload bytes, interval is the time
+// between uplinks in ms. May add a link check request and change the DR.
+void linkAdaptTx(uint8_t plen, uint32_t interval);
+
+// Call on EV_TXCOMPLETE, adapts DR and power to what was heard back
+void linkAdaptTxComplete();
+
+// The counters, to keep them across a shutdown together with the session
+uint32_t linkAdaptState();
+void linkAdaptSetState(uint32_t state);
+
+#endif // LINK_ADAPT_H
@@ -39,11 +39,15 @@
 #include <SPI.h>
 #include "STM32LowPower.h"
 #include "STM32IntRef.h"
+#include "session_store.h"
+#include "link_adapt.h"
+#include "power.h"
 
 #include "sml.h"
 #include <RingBuf.h>
 
 void do_send(osjob_t* j);
+void read_sml(osjob_t* j);
 
 // #define Serial Serial2
 HardwareSerial Serial2(USART2);   // or HardWareSerial Serial2 (PA3, PA2);
@@ -177,15 +181,28 @@ void os_getDevKey (u1_t* buf) {  memcpy_P(buf, APPKEY, 16);}
 #endif
 
 static osjob_t sendjob;
+static osjob_t ledjob;
+
+// Serial2 is being read, see read_sml()
+static bool reading;
+static uint16_t readPolls;
 
 // led for signing a packet is send
 #define SIGNAL_LED PA1
 
-// Sleep this many microseconds. Notice that the sending and waiting for downlink
-// will extend the time between send packets. You have to extract this time
+// Milliseconds between uplinks. They go out on the multiples of this since
+// midnight of the RTC, reading the meter and waiting for a downlink do not
+// add to it. Has to divide a day, and 15 minutes to stay on the quarter hours
 // #define SLEEP_INTERVAL 300000
 #define SLEEP_INTERVAL 300000
 
+// Power down completely between uplinks (STM32 standby, RTC running) instead
+// of the stop mode. The node starts again in setup() and continues the LMIC
+// session stored in the data EEPROM. Uncomment to use it, without it the
+// node uses stop mode. Either way power.h decides when, from the jobs LMIC
+// has queued.
+// #define SLEEP_SHUTDOWN
+
 // Pin mapping for the MiniPill LoRa with the RFM95 LoRa chip
 const lmic_pinmap lmic_pins =
     {
@@ -223,6 +240,8 @@ void onEvent(ev_t ev)
     // Disable link check validation (automatically enabled
     // during join, but not supported by TTN at this time).
     LMIC_setLinkCheckMode(0);
+    // data rate and power come from link_adapt.h, not from the network
+    LMIC_setAdrMode(0);
     break;
   case EV_RFU1:
     Serial.println(F("EV_RFU1"));
@@ -250,19 +269,26 @@ void onEvent(ev_t ev)
       }
       Serial.println();
     }
-    Serial.println("going to sleep");
-    // reset low power parameters
-    LowPower.begin();
-    delay(100);
-    // set PA6 to analog to reduce power due to currect flow on DIO on BME280
-    pinMode(PA6, INPUT_ANALOG);
-    // take SLEEP_INTERVAL time to sleep
-    LowPower.deepSleep(SLEEP_INTERVAL);
-
-    // Serial.println("queing next job");
-    // next transmission
-    do_send(&sendjob);
-
+    // data rate and power for the next uplink from what was heard back
+    linkAdaptTxComplete();
+    Serial.print(F("next uplink DR "));
+    Serial.print(LMIC.datarate);
+    Serial.print(F(", "));
+    Serial.print(LMIC.adrTxPow);
+    Serial.println(F(" dBm"));
+    if (powerStats().count[POWER_STOP])
+    {
+      Serial.print(F("stop mode wakeup "));
+      Serial.print(powerStats().wakeUs);
+      Serial.print(F(" us, at most "));
+      Serial.print(powerStats().maxWakeUs);
+      Serial.println(F(" us"));
+    }
+    // keep frame counters and duty cycle for the next start
+    sessionSave(linkAdaptState());
+    // next transmission on the next slot of the RTC, the run loop sleeps
+    // until then
+    os_setTimedCallback(&sendjob, os_getTime() + ms2osticks(powerUntilSlot(SLEEP_INTERVAL)), do_send);
     break;
   case EV_LOST_TSYNC:
     Serial.println(F("EV_LOST_TSYNC"));
@@ -286,6 +312,20 @@ void onEvent(ev_t ev)
   }
 }
 
+// Before standby (SLEEP_SHUTDOWN), the session was saved on EV_TXCOMPLETE
+void prepare_standby()
+{
+  // for a warm start after the wakeup
+  randSeedSave();
+  // set PA6 to analog to reduce power due to currect flow on DIO on BME280
+  pinMode(PA6, INPUT_ANALOG);
+}
+
+void led_off(osjob_t* j)
+{
+  digitalWrite(SIGNAL_LED, HIGH);
+}
+
 //
 void do_send(osjob_t* j)
 {
@@ -295,68 +335,92 @@ void do_send(osjob_t* j)
     Serial.println(F("OP_TXRXPEND, not sending"));
   } else
   {
-    uint32_t timeout_cnt = 0;
     Serial.print(os_getTime());
     Serial.print(": ");
     Serial.print(F("beginning to read SML ..."));
-    while( (Serial2.available() <= 0) && (timeout_cnt <= 500) ) {
-      // __asm__("nop\n\t");
-      delay(10);
-      timeout_cnt += 1;
-    }
-
-    if (timeout_cnt > 500)
-    {
-      Serial.print(F("timeout while reading!!\n"));
-    }
-    else
-    {
-      while (Serial2.available() > 0)
-      {
-        readByte(Serial2.read());
-      }
+    // What came in while the node was awake for the last uplink (TX and RX
+    // windows) is minutes old, start with the next bytes from the meter
+    while (Serial2.available() > 0)
+      Serial2.read();
+    reading = true;
+    readPolls = 0;
+    read_sml(j);
+  }
+}
 
-      
+// Wait up to 5 s for the meter, polling every 10 ms from a timed job so
+// the run loop can sleep in between
+void read_sml(osjob_t* j)
+{
+  if ((Serial2.available() <= 0) && (readPolls <= 500)) {
+    readPolls += 1;
+    os_setTimedCallback(j, os_getTime() + ms2osticks(10), read_sml);
+    return;
+  }
+  reading = false;
 
-      Serial.print(F("end of reading SML!!"));
+  if (readPolls > 500)
+  {
+    Serial.print(F("timeout while reading!!\n"));
+  }
+  else
+  {
+    while (Serial2.available() > 0)
+    {
+      readByte(Serial2.read());
     }
 
-    // Prepare upstream data transmission at the next possible time.
-    // uint8_t dataLength = 2;
-    // uint8_t data[dataLength];
-
-    // read vcc and add to bytebuffer
-    // int32_t vcc = IntRef.readVref();
-    // data[0] = (vcc >> 8) & 0xff;
-    // data[1] = (vcc & 0xff);
-
-    LMIC_setTxData2(1, (uint8_t* )floatBuffer, sizeof(floatBuffer), 0);
-    Serial.println(F("Packet queued"));
-    // signal with LED that data is queued
-    digitalWrite(SIGNAL_LED, LOW);
-    delay(1000);
-    digitalWrite(SIGNAL_LED, HIGH);
+    
 
+    Serial.print(F("end of reading SML!!"));
   }
+
+  // Prepare upstream data transmission at the next possible time.
+  // uint8_t dataLength = 2;
+  // uint8_t data[dataLength];
+
+  // read vcc and add to bytebuffer
+  // int32_t vcc = IntRef.readVref();
+  // data[0] = (vcc >> 8) & 0xff;
+  // data[1] = (vcc & 0xff);
+
+  linkAdaptTx(sizeof(floatBuffer), SLEEP_INTERVAL);
+  LMIC_setTxData2(1, (uint8_t* )floatBuffer, sizeof(floatBuffer), 0);
+  Serial.println(F("Packet queued"));
+  // signal with LED that data is queued
+  digitalWrite(SIGNAL_LED, LOW);
+  os_setTimedCallback(&ledjob, os_getTime() + ms2osticks(1000), led_off);
 }
 
 void setup()
 {
+  // Woken up from standby (SLEEP_SHUTDOWN): the radio kept its configuration
+  // and calibration in sleep mode and the random seed is in the backup
+  // registers, so the radio reset and the noise sampling can be skipped.
+  // Check before LowPower.begin(), which clears the standby flag.
+  uint8_t seed[RADIO_RAND_SEED_SIZE];
+  bool warm = __HAL_PWR_GET_FLAG(PWR_FLAG_SB) != RESET && randSeedRestore(seed);
+
   Serial.begin(9600);
   Serial2.begin(9600);
-  // delay at startup for debugging reasons
-  delay(8000);
-  Serial.println(F("Starting"));
+  // delay at startup for debugging reasons, only after power up
+  if (!warm)
+    delay(8000);
+  Serial.println(warm ? F("Starting (warm)") : F("Starting"));
 
   // set pin as OUPUT for LED
   pinMode(SIGNAL_LED, OUTPUT);
   digitalWrite(SIGNAL_LED, HIGH);
 
   // LMIC init
-  os_init();
+  if (warm)
+    os_initWarm(seed);
+  else
+    os_init();
   // Reset the MAC state. Session and pending data transfers will be discarded.
   LMIC_reset();
-  // to incrise the size of the RX window.
+  // to incrise the size of the RX window. This is the worst case, LMIC
+  // narrows the window again from the drift measured on received downlinks.
   LMIC_setClockError(MAX_CLOCK_ERROR * 25 / 100);
 
   // Set static session parameters when using ABP.
@@ -367,21 +431,47 @@ void setup()
   uint8_t nwkskey[sizeof(NWKSKEY)];
   memcpy_P(appskey, APPSKEY, sizeof(APPSKEY));
   memcpy_P(nwkskey, NWKSKEY, sizeof(NWKSKEY));
-  LMIC_setSession (0x1, DEVADDR, nwkskey, appskey);
-  // These settings are needed for correct communication. By removing them you
-  // get empty downlink messages
-  // Disable ADR
-  LMIC_setAdrMode(0);
-  // TTN uses SF9 for its RX2 window.
-  LMIC.dn2Dr = DR_SF9;
-  // prevent some downlink messages, TTN advanced setup is set to the default 5
-  LMIC.rxDelay = 5;
-  // Set data rate and transmit power for uplink (note: txpow seems to be ignored by the library)
-  LMIC_setDrTxpow(DR_SF12,14);
+  // Continue the stored session (frame counters, settings below), unless it
+  // belongs to other keys
+  uint32_t adaptState = 0;
+  if (sessionRestore(&adaptState) && LMIC.devaddr == DEVADDR && memcmp(LMIC.nwkKey, nwkskey, 16) == 0 &&
+      memcmp(LMIC.artKey, appskey, 16) == 0)
+  {
+    Serial.print(F("Session restored, seqnoUp "));
+    Serial.println(LMIC.seqnoUp);
+    linkAdaptSetState(adaptState);
+  } else
+  {
+    LMIC_reset();
+    LMIC_setClockError(MAX_CLOCK_ERROR * 25 / 100);
+    LMIC_setSession (0x1, DEVADDR, nwkskey, appskey);
+    // These settings are needed for correct communication. By removing them you
+    // get empty downlink messages
+    // Disable ADR, the node adapts data rate and power itself (link_adapt.h)
+    LMIC_setAdrMode(0);
+    // and falls back on its own when there are no answers
+    LMIC_setLinkCheckMode(0);
+    // TTN uses SF9 for its RX2 window.
+    LMIC.dn2Dr = DR_SF9;
+    // prevent some downlink messages, TTN advanced setup is set to the default 5
+    LMIC.rxDelay = 5;
+    // Start with the slowest data rate and full power for uplink
+    LMIC_setDrTxpow(DR_SF12,14);
+  }
+  #else
+  // a joined session, if there is one
+  uint32_t adaptState;
+  if (sessionRestore(&adaptState))
+    linkAdaptSetState(adaptState);
   #endif
 
   // Configure low power at startup
   LowPower.begin();
+#ifdef SLEEP_SHUTDOWN
+  powerBegin(&sendjob, prepare_standby);
+#else
+  powerBegin(&sendjob, NULL);
+#endif
 
   // Start job (sending automatically starts OTAA too, or first ABP message)
   do_send(&sendjob);
@@ -389,6 +479,8 @@ void setup()
 
 void loop()
 {
+  // sleep until the next job, as deep as what is going on allows
+  powerSleep(reading);
   // run the os_loop to check if a job is available
   os_runloop_once();
 }
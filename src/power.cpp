@@ -0,0 +1,91 @@
+/*
+  power.cpp
+  Sleep policy of the node, see power.h
+*/
+
+#include <lmic.h>
+#include "STM32LowPower.h"
+#include "power.h"
+
+// Shorter waits stay in the run loop, stop mode costs restarting the clocks
+#define STOP_MIN_MS 20
+// Wake up this much before the job: clock restart and RTC resolution
+#define STOP_EARLY_MS 4
+
+#define DAY_MS 86400000UL
+
+// MAC activity standby would lose, the rest of opmode are settings
+#define OP_ACTIVE (OP_SCAN | OP_TRACK | OP_JOINING | OP_TXDATA | OP_POLL | OP_REJOIN | OP_TXRXPEND | OP_PINGINI)
+
+static osjob_t *wakeJob;
+static void (*standbySave)();
+static PowerStats stats;
+
+void powerBegin(osjob_t *job, void (*save)())
+{
+  wakeJob = job;
+  standbySave = save;
+  // keeps the time if the RTC has been running through the standby
+  STM32RTC::getInstance().begin();
+}
+
+PowerMode powerMode(bool uartBusy, uint32_t *ms)
+{
+  ostime_t deadline;
+  osjob_t *next = os_getNextJob(&deadline);
+  // nothing queued: only an interrupt (DIO) can bring something
+  if (next == NULL)
+    return POWER_SLEEP;
+  s4_t wait = osticks2ms(deadline - os_getTime());
+  if (wait < STOP_MIN_MS)
+    return POWER_IDLE;
+  if (uartBusy || (LMIC.opmode & OP_TXRXPEND))
+    return POWER_SLEEP;
+  *ms = wait;
+  if (standbySave && next == wakeJob && !(LMIC.opmode & OP_ACTIVE))
+    return POWER_STANDBY;
+  return POWER_STOP;
+}
+
+// Time of day on the RTC in ms, read and set without calendar conversions
+static uint32_t rtcMs()
+{
+  return STM32RTC::getInstance().getDayMs();
+}
+
+static uint32_t dayAdd(uint32_t dayMs, uint32_t ms)
+{
+  return (dayMs + ms) % DAY_MS;
+}
+
+uint32_t powerUntilSlot(uint32_t period)
+{
+  return period - rtcMs() % period;
+}
+
+PowerMode powerSleep(bool uartBusy)
+{
+  uint32_t ms = 0;
+  PowerMode mode = powerMode(uartBusy, &ms);
+  stats.count[mode]++;
+  if (mode == POWER_STOP) {
+    // the UART stops with the clocks, let it send what is left
+    Serial.flush();
+    uint32_t start = rtcMs();
+    LowPower.deepSleepUntil(dayAdd(start, ms - STOP_EARLY_MS));
+    // SysTick did not count, micros() and so the LMIC time stood still
+    uint32_t slept = (rtcMs() + DAY_MS - start) % DAY_MS;
+    hal_addTicks(ms2osticks(slept));
+    stats.stopMs += slept;
+    stats.wakeUs = LowPower.wakeupLatency();
+    if (stats.wakeUs > stats.maxWakeUs)
+      stats.maxWakeUs = stats.wakeUs;
+  } else if (mode == POWER_STANDBY) {
+    standbySave();
+    Serial.flush();
+    LowPower.shutdownUntil(dayAdd(rtcMs(), ms));
+  }
+  return mode;
+}
+
+const PowerStats &powerStats() { return stats; }
@@ -0,0 +1,56 @@
+/*
+  power.h
+  Sleep policy of the node. The run loop asks before every round how to
+  wait for the next LMIC job, the answer depends on how far away it is and
+  on what is still going on:
+
+    IDLE     the job is due (or nearly), the run loop goes on
+    SLEEP    the radio has a TX/RX pending or a UART is busy: the run
+             loop's WFI, clocks and SysTick keep running for the timing
+    STOP     stop mode until shortly before the job, the RTC alarm wakes
+             the core and the LMIC clock is moved on by the time asleep
+    STANDBY  the MAC is idle and the next job is the one setup() starts
+             again anyway: standby until then, waking up with a reset
+
+  Nothing else in the firmware sleeps or waits for long, jobs that have to
+  wait are timed jobs.
+
+  The RTC alarm is set to the time of day of the job in ms, so a job timed
+  by powerUntilSlot() is woken up for on its slot, without drift.
+*/
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include <lmic.h>
+
+enum PowerMode : uint8_t { POWER_IDLE, POWER_SLEEP, POWER_STOP, POWER_STANDBY, POWER_MODES };
+
+struct PowerStats {
+  uint32_t count[POWER_MODES]; // decisions per mode
+  uint32_t stopMs;             // time in stop mode, from the RTC
+  uint32_t wakeUs, maxWakeUs;  // wakeup latency from stop mode, last and most
+};
+
+// Standby ends in a reset: job is the one setup() runs again, save() is
+// called before to keep what has to survive. Without save the deepest
+// mode is STOP.
+void powerBegin(osjob_t *job, void (*save)());
+
+// The mode for waiting on the next LMIC job, ms is how long to sleep in
+// STOP or STANDBY. uartBusy keeps the clocks of the UARTs running.
+PowerMode powerMode(bool uartBusy, uint32_t *ms);
+
+// Call from loop() before os_runloop_once(): sleeps in the mode
+// powerMode() picks. Does not return from STANDBY.
+PowerMode powerSleep(bool uartBusy);
+
+// Milliseconds to the next multiple of period (ms, dividing a day) in the
+// time of day of the RTC. Timing a job with it keeps a fixed cadence, the
+// next slot is the previous one plus period however long the work took.
+uint32_t powerUntilSlot(uint32_t period);
+
+const PowerStats &powerStats();
+
+#endif // POWER_H
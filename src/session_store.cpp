@@ -0,0 +1,166 @@
+/*
+  session_store.cpp
+  LMIC session in the data EEPROM, see session_store.h
+*/
+
+#include <Arduino.h>
+#include <lmic.h>
+#include <STM32RTC.h>
+#include <backup.h>
+#include "session_store.h"
+
+// Slot layout, all 32 bit words:
+//   seq     number of the save, 0 in an erased slot. Written last.
+//   epoch   RTC seconds at the time of the save
+//   check   length of the session in the low half, CRC16 in the high half
+//   user    the application's word, see sessionSave()
+//   layout  SLOT_LAYOUT at the time of the save
+//   session LMIC_saveSession() output, padded to whole words
+#define SLOT_HEADER_WORDS 5
+#define SESSION_WORDS ((LMIC_SESSION_SIZE + 3) / 4)
+#define SLOT_SIZE (4 * (SLOT_HEADER_WORDS + SESSION_WORDS))
+#define SLOT_COUNT ((DATA_EEPROM_END - DATA_EEPROM_BASE + 1) / SLOT_SIZE)
+
+// Change when the slot layout or the meaning of the user word changes, a
+// slot saved with another layout is ignored. Slots from before the layout
+// word (without or with the user word) count as 0 and 1.
+#define SLOT_LAYOUT 2
+
+// Longest wait for the duty cycle that can be left over from a save,
+// anything older than this has expired
+#define MAX_ELAPSED_SECONDS 3600
+
+static volatile uint32_t *slotWords(uint32_t slot)
+{
+  return (volatile uint32_t *)(DATA_EEPROM_BASE + slot * SLOT_SIZE);
+}
+
+// CRC-16/CCITT over the epoch, the user word and the session
+static uint16_t crc16(uint32_t epoch, uint32_t user, const uint8_t *data, uint32_t len)
+{
+  uint16_t crc = 0xFFFF;
+  uint8_t head[8];
+  os_wlsbf4(head, epoch);
+  os_wlsbf4(head + 4, user);
+  for (uint32_t i = 0; i < 8 + len; i++) {
+    crc ^= (uint16_t)(i < 8 ? head[i] : data[i - 8]) << 8;
+    for (uint8_t b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// Find the newest valid slot saved before seq below, returns its seq or 0
+// if there is none
+static uint32_t newestSlot(uint32_t *slot, uint32_t below = UINT32_MAX)
+{
+  uint32_t best = 0;
+  for (uint32_t s = 0; s < SLOT_COUNT; s++) {
+    volatile uint32_t *w = slotWords(s);
+    uint32_t seq = w[0];
+    uint32_t len = w[2] & 0xFFFF;
+    if (seq <= best || seq >= below || len > LMIC_SESSION_SIZE || w[4] != SLOT_LAYOUT)
+      continue;
+    if (crc16(w[1], w[3], (const uint8_t *)(w + SLOT_HEADER_WORDS), len) != (w[2] >> 16))
+      continue;
+    best = seq;
+    *slot = s;
+  }
+  return best;
+}
+
+static uint32_t rtcEpoch()
+{
+  STM32RTC &rtc = STM32RTC::getInstance();
+  // keeps the time if the RTC has been running through the standby
+  rtc.begin();
+  return rtc.getEpoch();
+}
+
+static void program(volatile uint32_t *addr, uint32_t value)
+{
+  // every write wears the cell, skip what is already there
+  if (*addr != value)
+    HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, (uintptr_t)addr, value);
+}
+
+void sessionSave(uint32_t user)
+{
+  uint32_t session[SESSION_WORDS] = {0};
+  uint32_t len = LMIC_saveSession((uint8_t *)session);
+  uint32_t epoch = rtcEpoch();
+
+  uint32_t slot = SLOT_COUNT - 1;
+  uint32_t seq = newestSlot(&slot) + 1;
+  slot = (slot + 1) % SLOT_COUNT;
+  volatile uint32_t *w = slotWords(slot);
+
+  HAL_FLASHEx_DATAEEPROM_Unlock();
+  for (uint32_t i = 0; i < SESSION_WORDS; i++)
+    program(&w[SLOT_HEADER_WORDS + i], session[i]);
+  program(&w[4], SLOT_LAYOUT);
+  program(&w[3], user);
+  program(&w[2], len | ((uint32_t)crc16(epoch, user, (const uint8_t *)session, len) << 16));
+  program(&w[1], epoch);
+  program(&w[0], seq);
+  HAL_FLASHEx_DATAEEPROM_Lock();
+}
+
+// Restore from the given slot, false if LMIC does not take the session
+static bool restoreSlot(uint32_t slot, uint32_t *user)
+{
+  volatile uint32_t *w = slotWords(slot);
+  uint32_t session[SESSION_WORDS];
+  for (uint32_t i = 0; i < SESSION_WORDS; i++)
+    session[i] = w[SLOT_HEADER_WORDS + i];
+
+  // After a power loss the RTC starts over and the time in between is
+  // unknown, then the remaining duty cycle waits are kept in full.
+  uint32_t now = rtcEpoch();
+  uint32_t elapsed = now >= w[1] ? now - w[1] : 0;
+  if (elapsed > MAX_ELAPSED_SECONDS)
+    elapsed = MAX_ELAPSED_SECONDS;
+
+  if (!LMIC_restoreSession((const uint8_t *)session, w[2] & 0xFFFF, sec2osticks(elapsed)))
+    return false;
+  *user = w[3];
+  return true;
+}
+
+bool sessionRestore(uint32_t *user)
+{
+  // a slot LMIC refuses falls back to the one saved before it
+  uint32_t slot;
+  for (uint32_t seq = newestSlot(&slot); seq != 0; seq = newestSlot(&slot, seq)) {
+    if (restoreSlot(slot, user))
+      return true;
+  }
+  return false;
+}
+
+// The L0 has 5 backup registers, one of them marks the RTC as configured.
+// The seed goes into the others in order.
+#define SEED_WORDS (RADIO_RAND_SEED_SIZE / 4)
+
+void randSeedSave()
+{
+  uint8_t seed[RADIO_RAND_SEED_SIZE];
+  radio_getRandSeed(seed);
+  enableBackupDomain();
+  for (uint32_t reg = 0, i = 0; i < SEED_WORDS; reg++) {
+    if (reg == RTC_BKP_INDEX)
+      continue;
+    setBackupRegister(reg, os_rlsbf4(seed + 4 * i++));
+  }
+}
+
+bool randSeedRestore(uint8_t *seed)
+{
+  for (uint32_t reg = 0, i = 0; i < SEED_WORDS; reg++) {
+    if (reg == RTC_BKP_INDEX)
+      continue;
+    os_wlsbf4(seed + 4 * i++, getBackupRegister(reg));
+  }
+  // cleared by a power loss, the first byte is the index into the seed
+  return seed[0] != 0;
+}
@@ -0,0 +1,38 @@
+/*
+  session_store.h
+  Keeps the LMIC session (frame counters, channels, duty cycle) in the data
+  EEPROM of the STM32L0, so the node can power down completely between
+  uplinks and continue where it left off after the reset.
+
+  The EEPROM is used as a ring of slots. Every save goes to the slot after
+  the newest one and only rewrites the words that changed, load picks the
+  newest slot of the current layout with a valid checksum that
+  LMIC_restoreSession() accepts. A save that is interrupted leaves the
+  previous slot intact.
+
+  The random seed of the radio is kept separately for a warm start, see
+  randSeedSave().
+*/
+
+#ifndef SESSION_STORE_H
+#define SESSION_STORE_H
+
+#include <stdint.h>
+
+// Write the current LMIC session to the next slot, user is stored along
+// with it for the application's own state
+void sessionSave(uint32_t user);
+
+// Restore the newest stored session into LMIC and its user word. LMIC_reset()
+// must have been called before. Returns false if there is none, then LMIC
+// and user are unchanged.
+bool sessionRestore(uint32_t *user);
+
+// The random seed of the radio (radio_getRandSeed) in the RTC backup
+// registers, which survive standby but not a power loss
+void randSeedSave();
+
+// Read the seed back for os_initWarm(), false if there is none
+bool randSeedRestore(uint8_t *seed);
+
+#endif // SESSION_STORE_H
@@ -0,0 +1,96 @@
+#include <Arduino.h>
+#include <STM32LowPower.h>
+#include <lmic.h>
+#include "sim_radio.h"
+#include "unity.h"
+
+void setup();
+void loop();
+
+// Run the firmware like the native main() does, resets included. Stops
+// at the first standby after the given time, so every uplink started
+// has completed.
+static void runFor(double seconds)
+{
+  static uint64_t end;
+  end = sim.us + (uint64_t)(seconds * 1e6);
+  setjmp(sim_reset_point);
+  sim_reset_armed = true;
+  if (sim.us < end) {
+    setup();
+    for (;;)
+      loop();
+  }
+  sim_reset_armed = false;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// All tests continue the same run, the firmware cannot be started over
+// without a power loss
+
+void test_first_uplink(void)
+{
+  runFor(1);
+  TEST_ASSERT_EQUAL(1, simRadio.tx);
+  TEST_ASSERT_EQUAL(1, LMIC.seqnoUp);
+  // an unconfirmed data uplink of our DevAddr on port 1
+  TEST_ASSERT_EQUAL_HEX8(HDR_FTYPE_DAUP | HDR_MAJOR_V1, simRadio.fifo[OFF_DAT_HDR]);
+  TEST_ASSERT_EQUAL_HEX32(0x260B5215, os_rlsbf4(simRadio.fifo + OFF_DAT_ADDR));
+  TEST_ASSERT_EQUAL(0, simRadio.fifo[OFF_DAT_SEQNO]); // FCnt of the first frame
+  TEST_ASSERT_EQUAL(1, sim.shutdowns);
+  // the radio was on for the airtime of the frame, the first one goes
+  // out at DR0 (SF12)
+  uint8_t plen = simRadio.regs[0x22]; // RegPayloadLength
+  TEST_ASSERT_EQUAL(osticks2us(calcAirTime(makeRps(SF12, BW125, CR_4_5, 0, 0), plen)), simRadio.txUs);
+  TEST_ASSERT_EQUAL(2, simRadio.rx);
+}
+
+void test_session_continues_after_standby(void)
+{
+  runFor(3600);
+  // one uplink on every multiple of SLEEP_INTERVAL (300 s) of the RTC,
+  // reading and sending do not add to it
+  TEST_ASSERT_INT_WITHIN(1, 13, simRadio.tx);
+  TEST_ASSERT_EQUAL(simRadio.tx, LMIC.seqnoUp);
+  TEST_ASSERT_EQUAL(simRadio.tx, sim.shutdowns);
+  TEST_ASSERT_EQUAL(simRadio.tx - 1, simRadio.fifo[OFF_DAT_SEQNO]);
+  // warm starts: the radio was reset once, at power up
+  TEST_ASSERT_TRUE(sim.standby);
+}
+
+void test_wakeup_on_the_slot(void)
+{
+  // runFor() stopped at a wakeup from standby, at the time of day of the
+  // next slot
+  uint32_t ms = (STM32RTC::getInstance().getDayMs() + 1000) % 300000;
+  TEST_ASSERT_INT_WITHIN(5, 1000, ms);
+}
+
+void test_mostly_asleep(void)
+{
+  double awake = (double)(sim.us - sim.sleptUs - sim.lowPowerUs) / sim.us;
+  char msg[64];
+  snprintf(msg, sizeof(msg), "awake %.2f%% of %.0f s", 100 * awake, sim.us / 1e6);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_LESS_THAN(10, (int)(100 * awake));
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_first_uplink);
+  RUN_TEST(test_session_continues_after_standby);
+  RUN_TEST(test_wakeup_on_the_slot);
+  RUN_TEST(test_mostly_asleep);
+  return UNITY_END();
+}
+
+int main(void)
+{
+  sim_uart_out = NULL;
+  simRadioAttach();
+  return runUnityTests();
+}
@@ -0,0 +1,65 @@
+#include <Arduino.h>
+#include <lmic.h>
+#include "link_adapt.h"
+#include "sim_radio.h"
+#include "unity.h"
+
+#define PLEN 10
+#define INTERVAL 300000
+
+// An uplink as main.cpp sends it, answered with the given link check
+// margin if it carried a request (-1: no answer). Like an LMIC that does
+// not clear it, the last answer stays in LMIC.lchkMargin/lchkGws.
+static void uplink(int margin)
+{
+  linkAdaptTx(PLEN, INTERVAL);
+  bool check = LMIC.lchkReq;
+  LMIC.lchkReq = 0;
+  if (check && margin >= 0) {
+    LMIC.lchkMargin = margin;
+    LMIC.lchkGws = 1;
+  }
+  LMIC.txrxFlags = 0;
+  linkAdaptTxComplete();
+}
+
+void setUp(void)
+{
+  LMIC_reset();
+  LMIC_setDrTxpow(DR_SF12, 14);
+  linkAdaptSetState(0);
+}
+
+void tearDown(void) {}
+
+void test_one_answer_is_used_once(void)
+{
+  // 16 dB: one step (3 dB) above the 10 dB reserve and the 3 dB hysteresis
+  uplink(16);
+  for (int i = 1; i < 8; i++)
+    uplink(-1);
+  // the first answer only counts towards the confirmation
+  TEST_ASSERT_EQUAL(DR_SF12, LMIC.datarate);
+  uplink(16);
+  TEST_ASSERT_EQUAL(DR_SF11, LMIC.datarate);
+  // the uplinks without a request do not see the answer again
+  for (int i = 1; i < 8; i++)
+    uplink(-1);
+  TEST_ASSERT_EQUAL(DR_SF11, LMIC.datarate);
+  TEST_ASSERT_EQUAL(14, LMIC.adrTxPow);
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_one_answer_is_used_once);
+  return UNITY_END();
+}
+
+int main(void)
+{
+  sim_uart_out = NULL;
+  simRadioAttach();
+  os_init();
+  return runUnityTests();
+}
@@ -0,0 +1,137 @@
+#include <Arduino.h>
+#include <STM32LowPower.h>
+#include "sim_meter.h"
+#include "sml.h"
+#include "unity.h"
+
+static uint8_t buf[1024];
+
+// Feed the bytes to the parser, return the last state
+static sml_states_t parse(const uint8_t *p, size_t n, double *t1Wh)
+{
+  static const unsigned char t1[6] = {0x01, 0x00, 0x01, 0x08, 0x01, 0xFF};
+  sml_states_t state = SML_START;
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = p[i];
+    state = smlState(c);
+    if (state == SML_LISTEND && smlOBISCheck(t1))
+      smlOBISWh(*t1Wh);
+  }
+  return state;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void test_telegram_parses(void)
+{
+  for (const SimMeterConfig *m = simMeterTypes; m->name; m++) {
+    double t1Wh = -1;
+    size_t n = simMeterTelegram(*m, 0, buf, sizeof(buf));
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(buf), n);
+    TEST_ASSERT_EQUAL_MESSAGE(SML_FINAL, parse(buf, n, &t1Wh), m->name);
+    TEST_ASSERT_EQUAL_FLOAT(10000000.0, t1Wh);
+  }
+}
+
+void test_values_evolve(void)
+{
+  const SimMeterConfig *m = simMeterFind("basic");
+  double t1Wh = -1;
+  size_t n = simMeterTelegram(*m, 3600000000ULL, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL(SML_FINAL, parse(buf, n, &t1Wh));
+  // 400 Wh an hour
+  TEST_ASSERT_EQUAL_FLOAT(10000400.0, t1Wh);
+}
+
+void test_bit_error_fails_checksum(void)
+{
+  const SimMeterConfig *m = simMeterFind("basic");
+  double t1Wh;
+  size_t n = simMeterTelegram(*m, 0, buf, sizeof(buf));
+  buf[n / 2] ^= 0x10;
+  TEST_ASSERT_NOT_EQUAL(SML_FINAL, parse(buf, n, &t1Wh));
+}
+
+// Bytes read after another millisecond
+static int readMs(HardwareSerial &port)
+{
+  int n = 0;
+  delay(1);
+  while (port.read() >= 0)
+    n++;
+  return n;
+}
+
+void test_bytes_arrive_at_baud_rate(void)
+{
+  HardwareSerial port(USART2);
+  SimMeterConfig m = *simMeterFind("basic");
+  size_t n = simMeterTelegram(m, 0, buf, sizeof(buf));
+  simMeterAttach(port, m);
+  port.begin(9600);
+
+  // wait for the pause between two telegrams, then time the next one
+  int quiet = 0;
+  while (quiet < 100)
+    quiet = readMs(port) ? 0 : quiet + 1;
+  int got;
+  while ((got = readMs(port)) == 0)
+    ;
+  uint64_t first = sim.us, last = first;
+  quiet = 0;
+  while (quiet < 100) {
+    int k = readMs(port);
+    got += k;
+    if (k) {
+      last = sim.us;
+      quiet = 0;
+    }
+    else
+      quiet++;
+  }
+  TEST_ASSERT_EQUAL(n, got);
+  // 10 bit times per byte at 9600 baud, polled every millisecond
+  TEST_ASSERT_UINT32_WITHIN(1100, (n - 1) * 10000000 / 9600, last - first);
+  port.end();
+  sim_uart_poll = 0;
+}
+
+void test_nothing_received_in_stop_mode(void)
+{
+  HardwareSerial port(USART2);
+  SimMeterConfig m = *simMeterFind("basic");
+  simMeterAttach(port, m);
+  port.begin(9600);
+
+  // awake, the telegrams come in
+  delay(3 * m.periodMs);
+  TEST_ASSERT_GREATER_THAN(0, port.available());
+  while (port.read() >= 0)
+    ;
+  // in stop mode the USART has no clock, the telegrams in between are lost
+  uint32_t telegrams = simMeter.telegrams;
+  LowPower.deepSleep(3 * m.periodMs);
+  TEST_ASSERT_EQUAL(0, port.available());
+  TEST_ASSERT_LESS_OR_EQUAL(telegrams + 1, simMeter.telegrams);
+  port.end();
+  sim_uart_poll = 0;
+  sim_stop_hook = 0;
+}
+
+int runUnityTests(void)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_telegram_parses);
+  RUN_TEST(test_values_evolve);
+  RUN_TEST(test_bit_error_fails_checksum);
+  RUN_TEST(test_bytes_arrive_at_baud_rate);
+  RUN_TEST(test_nothing_received_in_stop_mode);
+  return UNITY_END();
+}
+
+int main(void)
+{
+  return runUnityTests();
+}
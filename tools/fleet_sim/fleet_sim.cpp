@@ -0,0 +1,347 @@
+#include "fleet_sim.h"
+#include <algorithm>
+#include <math.h>
+#include <mutex>
+#include <vector>
+
+/* Nodes or packets per thread pool work item */
+#define CHUNK 1024
+
+/* A frame with another one on air past the last LOCK_SYMBOLS of its
+   preamble is lost, unless it is stronger by the capture threshold */
+#define PREAMBLE_SYMBOLS 8
+#define LOCK_SYMBOLS 5
+
+/* -174 dBm/Hz thermal noise, 125 kHz, 6 dB noise figure */
+#define NOISE_FLOOR (-117.0)
+
+/* Power steps of the nodes, as link_adapt.cpp */
+#define MIN_TXPOW 2
+#define POW_STEP 2
+
+/* Airtime allowed per uplink, in 1/1000 of the period (link_adapt.cpp) */
+#define AIRTIME_BUDGET_PERMILLE 10
+
+/* Status of a packet at a gateway */
+#define ST_IN_RANGE 1
+#define ST_SURVIVED 2
+#define ST_PATH 4
+
+/* splitmix64, for seeds that only depend on an index */
+static uint64_t mix64(uint64_t x)
+{
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+/* xorshift64, one per node so the result does not depend on the threads */
+struct Rng {
+  uint64_t s;
+  explicit Rng(uint64_t seed) : s(mix64(seed) | 1) {}
+  uint64_t next()
+  {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+  }
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+  double normal()
+  {
+    double u = 1.0 - uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * uniform());
+  }
+};
+
+struct Node {
+  uint8_t dr;
+  int8_t pow;
+};
+
+struct Packet {
+  double start, end; /* s */
+  uint32_t node;
+  uint8_t ch, dr;
+};
+
+static int spreadingFactor(dr_t dr) { return getSf(updr2rps(dr)) - SF7 + 7; }
+
+double fs_sensitivity(dr_t dr)
+{
+  /* SNR floor SF7 -7.5 dB, 2.5 dB less for each step up to SF12 -20 dB */
+  return NOISE_FLOOR - 7.5 - 2.5 * (spreadingFactor(dr) - 7);
+}
+
+static double symbolTime(dr_t dr) { return (double)(1 << spreadingFactor(dr)) / 125000; }
+
+/* Place the nodes, work out their links to the gateways and pick DR and power */
+static void placeNodes(ThreadPool &pool, const fs_config_t &cfg, std::vector<Node> &nodes, std::vector<float> &loss)
+{
+  unsigned G = cfg.gateways;
+  std::vector<double> gx(G), gy(G);
+  for (unsigned g = 0; g < G; g++) {
+    double r = cfg.radius * sqrt((double)g / G);
+    gx[g] = r * cos(g * 2.39996323);
+    gy[g] = r * sin(g * 2.39996323);
+  }
+  double sens[FS_NUM_DR];
+  for (int dr = 0; dr < FS_NUM_DR; dr++)
+    sens[dr] = fs_sensitivity((dr_t)dr);
+
+  pool.run(cfg.nodes, CHUNK, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      Rng rng(((uint64_t)cfg.seed << 32) + 2 * i);
+      double r = cfg.radius * sqrt(rng.uniform());
+      double a = 2 * M_PI * rng.uniform();
+      double x = r * cos(a), y = r * sin(a);
+      double best = INFINITY;
+      for (unsigned g = 0; g < G; g++) {
+        double d = hypot(x - gx[g], y - gy[g]);
+        if (d < 10)
+          d = 10;
+        double pl = cfg.pl1km + 10 * cfg.exponent * log10(d / 1000) + cfg.penetration +
+                    cfg.shadowing * rng.normal();
+        loss[i * G + g] = pl;
+        best = std::min(best, pl);
+      }
+
+      Node &n = nodes[i];
+      n.pow = cfg.txpow;
+      double total = 0;
+      for (int dr = 0; dr < FS_NUM_DR; dr++)
+        total += cfg.mix[dr];
+      if (total > 0) {
+        double pick = rng.uniform() * total;
+        n.dr = 0;
+        while (n.dr < FS_NUM_DR - 1 && pick >= cfg.mix[n.dr])
+          pick -= cfg.mix[n.dr++];
+        continue;
+      }
+      // fastest DR with the margin, then less power if there is room
+      n.dr = DR_SF12;
+      for (int dr = DR_SF7; dr >= DR_SF12; dr--) {
+        if (cfg.txpow - best >= sens[dr] + cfg.margin) {
+          n.dr = dr;
+          break;
+        }
+      }
+      if (n.dr == DR_SF7) {
+        while (n.pow - POW_STEP >= MIN_TXPOW && n.pow - POW_STEP - best >= sens[n.dr] + cfg.margin)
+          n.pow -= POW_STEP;
+      }
+      while (n.dr < DR_SF7 && cfg.airtime[n.dr] * 1000 > cfg.period * AIRTIME_BUDGET_PERMILLE)
+        n.dr++;
+    }
+  });
+}
+
+/* Uplinks of each node, one per slot of period and held back by the
+   duty cycle of the bands, like LMIC's nextTx() and updateTx() */
+static uint64_t sendUplinks(ThreadPool &pool, const fs_config_t &cfg, const std::vector<Node> &nodes,
+                            std::vector<Packet> &packets)
+{
+  size_t chunks = (cfg.nodes + CHUNK - 1) / CHUNK;
+  std::vector<std::vector<Packet>> parts(chunks);
+  std::vector<uint64_t> deferred(chunks);
+
+  pool.run(cfg.nodes, CHUNK, [&](size_t begin, size_t end) {
+    std::vector<Packet> &out = parts[begin / CHUNK];
+    for (size_t i = begin; i < end; i++) {
+      Rng rng(((uint64_t)cfg.seed << 32) + 2 * i + 1);
+      const Node &n = nodes[i];
+      double air = cfg.airtime[n.dr];
+      double avail[MAX_BANDS] = {0};
+      double slot = rng.uniform() * cfg.period;
+      double t = slot + rng.uniform() * cfg.extra;
+      bool held = false;
+      while (t < cfg.duration) {
+        // a random channel among those with their band free
+        uint8_t free[MAX_CHANNELS];
+        unsigned numFree = 0;
+        double soonest = INFINITY;
+        for (unsigned c = 0; c < cfg.numChannels; c++) {
+          double a = avail[cfg.channels[c].band];
+          if (a <= t)
+            free[numFree++] = c;
+          else
+            soonest = std::min(soonest, a);
+        }
+        if (numFree == 0) {
+          if (!held)
+            deferred[begin / CHUNK]++;
+          held = true;
+          t = soonest;
+          continue;
+        }
+        held = false;
+        uint8_t ch = free[rng.next() % numFree];
+        out.push_back({t, t + air, (uint32_t)i, ch, n.dr});
+        avail[cfg.channels[ch].band] = t + air * cfg.channels[ch].txcap;
+        // the next slot does not move with a late uplink
+        slot += cfg.period;
+        t = std::max(slot, t + air) + rng.uniform() * cfg.extra;
+      }
+    }
+  });
+
+  size_t total = 0;
+  for (auto &p : parts)
+    total += p.size();
+  packets.clear();
+  packets.reserve(total);
+  for (auto &p : parts)
+    packets.insert(packets.end(), p.begin(), p.end());
+  std::sort(packets.begin(), packets.end(), [](const Packet &a, const Packet &b) {
+    return a.start < b.start || (a.start == b.start && a.node < b.node);
+  });
+
+  uint64_t held = 0;
+  for (uint64_t d : deferred)
+    held += d;
+  return held;
+}
+
+/* Range and collisions of every packet at every gateway */
+static void receive(ThreadPool &pool, const fs_config_t &cfg, const std::vector<Node> &nodes,
+                    const std::vector<float> &loss, const std::vector<Packet> &packets, std::vector<uint8_t> &status)
+{
+  unsigned G = cfg.gateways;
+  double maxAir = 0, sens[FS_NUM_DR], lockAfter[FS_NUM_DR];
+  for (int dr = 0; dr < FS_NUM_DR; dr++) {
+    maxAir = std::max(maxAir, cfg.airtime[dr]);
+    sens[dr] = fs_sensitivity((dr_t)dr);
+    lockAfter[dr] = (PREAMBLE_SYMBOLS - LOCK_SYMBOLS) * symbolTime((dr_t)dr);
+  }
+
+  // frames only collide on the same channel
+  std::vector<std::vector<uint32_t>> byChannel(cfg.numChannels);
+  for (uint32_t i = 0; i < packets.size(); i++)
+    byChannel[packets[i].ch].push_back(i);
+
+  for (auto &idx : byChannel) {
+    pool.run(idx.size(), CHUNK, [&](size_t begin, size_t end) {
+      std::vector<uint32_t> others;
+      for (size_t i = begin; i < end; i++) {
+        const Packet &p = packets[idx[i]];
+        double lock = p.start + lockAfter[p.dr];
+        others.clear();
+        for (size_t j = i; j-- > 0;) {
+          const Packet &q = packets[idx[j]];
+          if (q.start + maxAir <= p.start)
+            break;
+          if (q.dr == p.dr && q.end > lock)
+            others.push_back(idx[j]);
+        }
+        for (size_t j = i + 1; j < idx.size() && packets[idx[j]].start < p.end; j++) {
+          const Packet &q = packets[idx[j]];
+          if (q.dr == p.dr && q.end > lock)
+            others.push_back(idx[j]);
+        }
+
+        for (unsigned g = 0; g < G; g++) {
+          double pr = nodes[p.node].pow - loss[(size_t)p.node * G + g];
+          uint8_t st = 0;
+          if (pr >= sens[p.dr]) {
+            st = ST_IN_RANGE | ST_SURVIVED;
+            for (uint32_t o : others) {
+              const Packet &q = packets[o];
+              if (pr - (nodes[q.node].pow - loss[(size_t)q.node * G + g]) < cfg.capture) {
+                st &= ~ST_SURVIVED;
+                break;
+              }
+            }
+          }
+          status[(size_t)idx[i] * G + g] = st;
+        }
+      }
+    });
+  }
+}
+
+/* Demodulator paths of each gateway, taken when a preamble in range
+   arrives and held to the end of the frame whether it makes it or not */
+static unsigned demodulate(ThreadPool &pool, const fs_config_t &cfg, const std::vector<Packet> &packets,
+                           std::vector<uint8_t> &status)
+{
+  unsigned G = cfg.gateways;
+  std::vector<unsigned> peak(G);
+  pool.run(G, 1, [&](size_t begin, size_t end) {
+    for (size_t g = begin; g < end; g++) {
+      std::vector<double> busyUntil(cfg.demodulators, 0);
+      for (size_t i = 0; i < packets.size(); i++) {
+        uint8_t &st = status[i * G + g];
+        if (!(st & ST_IN_RANGE))
+          continue;
+        const Packet &p = packets[i];
+        auto path = std::min_element(busyUntil.begin(), busyUntil.end());
+        if (path == busyUntil.end() || *path > p.start)
+          continue;
+        *path = p.end;
+        st |= ST_PATH;
+        unsigned busy = 0;
+        for (double b : busyUntil)
+          busy += b > p.start;
+        peak[g] = std::max(peak[g], busy);
+      }
+    }
+  });
+  return *std::max_element(peak.begin(), peak.end());
+}
+
+void fs_run(ThreadPool &pool, const fs_config_t &cfg, fs_result_t *res)
+{
+  unsigned G = cfg.gateways;
+  memset(res, 0, sizeof(*res));
+
+  std::vector<Node> nodes(cfg.nodes);
+  std::vector<float> loss((size_t)cfg.nodes * G);
+  placeNodes(pool, cfg, nodes, loss);
+  for (const Node &n : nodes)
+    res->nodesDr[n.dr]++;
+
+  std::vector<Packet> packets;
+  res->deferred = sendUplinks(pool, cfg, nodes, packets);
+
+  std::vector<uint8_t> status(packets.size() * G);
+  receive(pool, cfg, nodes, loss, packets, status);
+  res->peakDemod = demodulate(pool, cfg, packets, status);
+
+  std::mutex lock;
+  pool.run(packets.size(), CHUNK * 16, [&](size_t begin, size_t end) {
+    fs_result_t r;
+    memset(&r, 0, sizeof(r));
+    for (size_t i = begin; i < end; i++) {
+      const uint8_t *st = &status[i * G];
+      uint8_t any = 0;
+      bool ok = false;
+      for (unsigned g = 0; g < G; g++) {
+        any |= st[g];
+        ok |= st[g] == (ST_IN_RANGE | ST_SURVIVED | ST_PATH);
+      }
+      uint8_t dr = packets[i].dr;
+      r.sentDr[dr]++;
+      if (ok)
+        r.deliveredDr[dr]++;
+      else if (!(any & ST_IN_RANGE))
+        r.range++;
+      else if (any & ST_SURVIVED)
+        r.demod++;
+      else
+        r.collided++;
+    }
+    std::lock_guard<std::mutex> l(lock);
+    res->range += r.range;
+    res->demod += r.demod;
+    res->collided += r.collided;
+    for (int dr = 0; dr < FS_NUM_DR; dr++) {
+      res->sentDr[dr] += r.sentDr[dr];
+      res->deliveredDr[dr] += r.deliveredDr[dr];
+    }
+  });
+  for (int dr = 0; dr < FS_NUM_DR; dr++) {
+    res->sent += res->sentDr[dr];
+    res->delivered += res->deliveredDr[dr];
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef FLEET_SIM_H
+#define FLEET_SIM_H
+
+#include "thread_pool.h"
+
+// LMIC's data rates, channels and duty cycle bands
+#include <lmic.h>
+
+/*
+ * Capacity of a gateway deployment for a fleet of nodes like ours, worked
+ * out from when each uplink is on air instead of by running the stacks.
+ * Nodes send one uplink per period on a random channel of the LMIC
+ * defaults, keeping the duty cycle of the channel's band (txcap, as
+ * updateTx() in lmic.c does) and taking calcAirTime() for the frame.
+ *
+ * At every gateway an uplink is lost when it arrives below the
+ * demodulation floor, when a frame on the same channel and SF overlaps it
+ * past its preamble lock and is not at least the capture threshold
+ * weaker, or when all demodulators are busy. It is delivered when one
+ * gateway gets it through. Different SFs count as orthogonal.
+ */
+
+#define FS_NUM_DR (DR_SF7 + 1) /* DR_SF12 .. DR_SF7 */
+
+typedef struct {
+  uint32_t freq;
+  uint16_t txcap; /* duty cycle of the band is 1/txcap */
+  uint8_t band;
+} fs_channel_t;
+
+typedef struct {
+  unsigned nodes;
+  unsigned gateways; /* spread over the area on a sunflower spiral, the first in the middle */
+  double radius;     /* m, nodes are spread evenly over the disk */
+  double duration;   /* s of traffic */
+  double period;     /* s from one slot of a node to the next */
+  double extra;      /* s after the slot at random (reading the meter) */
+  double airtime[FS_NUM_DR]; /* s, of our frame, from calcAirTime() */
+
+  fs_channel_t channels[MAX_CHANNELS];
+  unsigned numChannels;
+
+  /* share of nodes per DR, all zero to pick the DR and power by the link
+     budget like link_adapt.cpp does */
+  double mix[FS_NUM_DR];
+  int8_t txpow;       /* dBm, the most a node sends with */
+  double margin;      /* dB above the demodulation floor when picking the DR */
+
+  /* path loss PL(d) = pl1km + 10 * exponent * log10(d / 1 km) + penetration,
+     plus a normal shadowing per node and gateway */
+  double pl1km, exponent, penetration, shadowing;
+
+  double capture;        /* dB a frame must be stronger than each one overlapping it */
+  unsigned demodulators; /* per gateway */
+  uint32_t seed;
+} fs_config_t;
+
+typedef struct {
+  uint64_t sent;
+  uint64_t delivered;
+  uint64_t range;     /* no gateway above the demodulation floor */
+  uint64_t collided;  /* in range, but lost to overlapping frames everywhere */
+  uint64_t demod;     /* would have made it, but no demodulator was free */
+  uint64_t deferred;  /* uplinks the duty cycle pushed back */
+  unsigned nodesDr[FS_NUM_DR];
+  uint64_t sentDr[FS_NUM_DR];
+  uint64_t deliveredDr[FS_NUM_DR];
+  unsigned peakDemod; /* most demodulators busy at once on any gateway */
+} fs_result_t;
+
+/* Demodulation floor in dBm for a DR at 125 kHz */
+double fs_sensitivity(dr_t dr);
+
+/* Run the fleet on all threads of the pool */
+void fs_run(ThreadPool &pool, const fs_config_t &cfg, fs_result_t *res);
+
+#endif
@@ -0,0 +1,246 @@
+#include "fleet_sim.h"
+#include <Arduino.h>
+#include <SPI.h>
+#include <hal/hal.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+/* Our uplink: floatBuffer of src/main.cpp behind the LoRaWAN header,
+   FPort and MIC (FRAME_OVERHEAD of link_adapt.cpp) */
+#define PAYLOAD_LEN 20
+#define FRAME_LEN (13 + PAYLOAD_LEN)
+
+/* SLEEP_INTERVAL of src/main.cpp: the slots of a node, reading the meter
+   takes up to 2 s after them */
+#define PERIOD 300
+#define EXTRA 2
+
+/* The extra channels TTN has in EU868, for -c 8 */
+#define TTN_CHANNELS 5
+#define TTN_FIRST_FREQ 867100000
+
+// LMIC only runs here to set up its default channels and bands, on the
+// simulated core of the native build (native/)
+#define PIN_NSS 1
+
+const lmic_pinmap lmic_pins = {
+  .nss = PIN_NSS,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst = LMIC_UNUSED_PIN,
+  .dio = {2, 3, LMIC_UNUSED_PIN},
+};
+
+void onEvent(ev_t ev) {}
+
+// Just enough of an SX1276 to get through radio_init(): a plain register
+// file with RegVersion and a noisy RssiWideband for the random seed
+static uint8_t regs[0x80];
+static int spiPos;
+static uint8_t spiAddr;
+
+static void radioPin(uint32_t pin, uint32_t val)
+{
+  if (pin == PIN_NSS && val == 0)
+    spiPos = 0;
+}
+
+static uint8_t radioSpi(uint8_t out)
+{
+  if (spiPos++ == 0) {
+    spiAddr = out;
+    return 0;
+  }
+  uint8_t addr = spiAddr & 0x7F;
+  if (spiAddr & 0x80) {
+    regs[addr] = out;
+    return 0;
+  }
+  if (addr == 0x2C) // RegRssiWideband
+    return rand();
+  return regs[addr];
+}
+
+/* Channels and duty cycle bands as LMIC sets them up for an ABP session */
+static void lmicChannels(fs_config_t *cfg, bool ttn)
+{
+  regs[0x42] = 0x12; // RegVersion
+  sim_pin_write = radioPin;
+  sim_spi_transfer = radioSpi;
+  os_init();
+  LMIC_reset();
+  LMIC_setSession(0x1, 0, NULL, NULL);
+  if (ttn) {
+    for (u1_t i = 0; i < TTN_CHANNELS; i++)
+      LMIC_setupChannel(3 + i, TTN_FIRST_FREQ + i * 200000, DR_RANGE_MAP(DR_SF12, DR_SF7), BAND_CENTI);
+  }
+  cfg->numChannels = 0;
+  for (u1_t ch = 0; ch < MAX_CHANNELS; ch++) {
+    if (!(LMIC.channelMap & (1 << ch)))
+      continue;
+    fs_channel_t &c = cfg->channels[cfg->numChannels++];
+    c.freq = LMIC.channelFreq[ch] & ~3;
+    c.band = LMIC.channelFreq[ch] & 3;
+    c.txcap = LMIC.bands[c.band].txcap;
+  }
+  for (int dr = 0; dr < FS_NUM_DR; dr++)
+    cfg->airtime[dr] = osticks2us(calcAirTime(updr2rps(dr), FRAME_LEN)) / 1e6;
+}
+
+/* "adr", or shares per SF like 12:20,9:30,7:50 */
+static bool parseMix(const char *arg, double mix[FS_NUM_DR])
+{
+  memset(mix, 0, sizeof(double) * FS_NUM_DR);
+  if (strcmp(arg, "adr") == 0)
+    return true;
+  while (*arg) {
+    char *p;
+    long sf = strtol(arg, &p, 10);
+    if (*p != ':' || sf < 7 || sf > 12)
+      return false;
+    mix[12 - sf] = strtod(p + 1, &p);
+    if (*p == ',')
+      p++;
+    arg = p;
+  }
+  return true;
+}
+
+static void printMix(const char *name, const fs_config_t &cfg)
+{
+  printf("\nSF mix %s", name);
+  if (strcmp(name, "adr") == 0)
+    printf(" (fastest DR %.0f dB above the demodulation floor, then less power)", cfg.margin);
+  printf("\n%8s %9s %7s %7s %7s %7s %5s %8s  %-23s  %s\n", "nodes", "uplinks", "deliv%", "range%", "coll%",
+         "demod%", "paths", "deferred", "nodes % SF7..SF12", "delivered % SF7..SF12");
+}
+
+static void printRow(const fs_config_t &cfg, const fs_result_t &r, double secs)
+{
+  double n = r.sent ? (double)r.sent : 1;
+  printf("%8u %9llu %7.2f %7.2f %7.2f %7.2f %5u %8llu ", cfg.nodes, (unsigned long long)r.sent,
+         100 * r.delivered / n, 100 * r.range / n, 100 * r.collided / n, 100 * r.demod / n, r.peakDemod,
+         (unsigned long long)r.deferred);
+  for (int dr = DR_SF7; dr >= DR_SF12; dr--)
+    printf(" %3.0f", 100.0 * r.nodesDr[dr] / cfg.nodes);
+  printf("  ");
+  for (int dr = DR_SF7; dr >= DR_SF12; dr--) {
+    if (r.sentDr[dr])
+      printf(" %5.1f", 100.0 * r.deliveredDr[dr] / r.sentDr[dr]);
+    else
+      printf("     -");
+  }
+  printf("  %.1f s\n", secs);
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr,
+          "usage: %s [-n nodes,...] [-s mix] [-g gateways] [-r radius] [-c 3|8] [-d seconds] [-t threads]\n"
+          "  -n  node counts to run, default 1000,10000,30000,100000\n"
+          "  -s  SF mix: adr, or shares like 12:20,9:30,7:50; repeat for a table per mix\n"
+          "  -g  gateways, default 1\n"
+          "  -r  radius of the area in m, default 2000\n"
+          "  -c  3 default channels, or 8 with the TTN ones\n"
+          "  -d  traffic to simulate in s, default 3600\n"
+          "  -t  threads, default all cores\n",
+          prog);
+}
+
+int main(int argc, char **argv)
+{
+  fs_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.gateways = 1;
+  cfg.radius = 2000;
+  cfg.duration = 3600;
+  cfg.period = PERIOD;
+  cfg.extra = EXTRA;
+  cfg.txpow = 14;
+  cfg.margin = 10; /* INSTALL_MARGIN of link_adapt.cpp */
+  /* Okumura-Hata, suburban, 868 MHz, gateway 30 m and node 1.5 m high,
+     10 dB more into the meter cupboard */
+  cfg.pl1km = 116.0;
+  cfg.exponent = 3.52;
+  cfg.penetration = 10;
+  cfg.shadowing = 6;
+  cfg.capture = 6;
+  cfg.demodulators = 8; /* SX1301 */
+  cfg.seed = 1;
+
+  std::vector<unsigned> counts = {1000, 10000, 30000, 100000};
+  std::vector<const char *> mixes;
+  unsigned threads = std::thread::hardware_concurrency();
+  bool ttn = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:g:r:c:d:t:")) != -1) {
+    switch (opt) {
+    case 'n':
+      counts.clear();
+      for (char *p = optarg; *p;) {
+        counts.push_back(strtoul(p, &p, 10));
+        if (*p == ',')
+          p++;
+        else if (*p)
+          return usage(argv[0]), 1;
+      }
+      break;
+    case 's':
+      if (!parseMix(optarg, cfg.mix))
+        return usage(argv[0]), 1;
+      mixes.push_back(optarg);
+      break;
+    case 'g':
+      cfg.gateways = atoi(optarg);
+      break;
+    case 'r':
+      cfg.radius = atof(optarg);
+      break;
+    case 'c':
+      ttn = atoi(optarg) == 8;
+      break;
+    case 'd':
+      cfg.duration = atof(optarg);
+      break;
+    case 't':
+      threads = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (mixes.empty())
+    mixes.push_back("adr");
+  if (cfg.gateways < 1 || counts.empty())
+    return usage(argv[0]), 1;
+
+  lmicChannels(&cfg, ttn);
+  ThreadPool pool(threads);
+  printf("%u gateway(s), %.0f m radius, %u channels, %.0f s of uplinks every %.0f s (+%.0f s), %d byte frames, %u threads\n",
+         cfg.gateways, cfg.radius, cfg.numChannels, cfg.duration, cfg.period, cfg.extra, FRAME_LEN, pool.size());
+  printf("airtime SF7..SF12:");
+  for (int dr = DR_SF7; dr >= DR_SF12; dr--)
+    printf(" %.0f", cfg.airtime[dr] * 1000);
+  printf(" ms, demodulation floor:");
+  for (int dr = DR_SF7; dr >= DR_SF12; dr--)
+    printf(" %.1f", fs_sensitivity(dr));
+  printf(" dBm\n");
+
+  for (const char *mix : mixes) {
+    parseMix(mix, cfg.mix);
+    printMix(mix, cfg);
+    for (unsigned n : counts) {
+      cfg.nodes = n;
+      fs_result_t r;
+      auto start = std::chrono::steady_clock::now();
+      fs_run(pool, cfg, &r);
+      std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+      printRow(cfg, r, d.count());
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include "aes_batch.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AES_BATCH_X86
+#endif
+
+static const uint8_t sbox[256] = {
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+  0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+  0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+  0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+  0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+  0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+  0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+  0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+  0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+  0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+  0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+  0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+  0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+  0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+  0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+/* Te0[x] = (2*S[x], S[x], S[x], 3*S[x]), Te1..Te3 are byte rotations */
+static uint32_t te[4][256];
+
+static uint32_t ror8(uint32_t w) { return (w >> 8) | (w << 24); }
+
+static uint8_t xtime(uint8_t b) { return (b << 1) ^ ((b & 0x80) ? 0x1b : 0); }
+
+static bool make_tables()
+{
+  for (int i = 0; i < 256; i++) {
+    uint8_t s = sbox[i];
+    uint32_t w = ((uint32_t)xtime(s) << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) |
+                 (uint32_t)(xtime(s) ^ s);
+    for (int t = 0; t < 4; t++) {
+      te[t][i] = w;
+      w = ror8(w);
+    }
+  }
+  return true;
+}
+
+static const bool tables_ready = make_tables();
+
+#if defined(AES_BATCH_X86)
+static bool use_hw = __builtin_cpu_supports("aes");
+#else
+static bool use_hw = false;
+#endif
+
+static uint32_t rmsbf4(const uint8_t *b)
+{
+  return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static void wmsbf4(uint8_t *b, uint32_t v)
+{
+  b[0] = v >> 24;
+  b[1] = v >> 16;
+  b[2] = v >> 8;
+  b[3] = v;
+}
+
+void aes_batch_key(aes_batch_key_t *key, const uint8_t k[16])
+{
+  uint32_t *w = key->ek;
+  uint8_t rcon = 1;
+
+  for (int i = 0; i < 4; i++)
+    w[i] = rmsbf4(k + 4 * i);
+  for (int i = 4; i < 44; i++) {
+    uint32_t t = w[i - 1];
+    if (i % 4 == 0) {
+      t = ((uint32_t)sbox[(t >> 16) & 0xff] << 24) | ((uint32_t)sbox[(t >> 8) & 0xff] << 16) |
+          ((uint32_t)sbox[t & 0xff] << 8) | sbox[t >> 24];
+      t ^= (uint32_t)rcon << 24;
+      rcon = xtime(rcon);
+    }
+    w[i] = w[i - 4] ^ t;
+  }
+  for (int i = 0; i < 44; i++)
+    wmsbf4(key->rk + 4 * i, w[i]);
+}
+
+static void encrypt_tables(const aes_batch_key_t *key, uint8_t blk[16])
+{
+  const uint32_t *k = key->ek;
+  uint32_t s0 = rmsbf4(blk) ^ k[0];
+  uint32_t s1 = rmsbf4(blk + 4) ^ k[1];
+  uint32_t s2 = rmsbf4(blk + 8) ^ k[2];
+  uint32_t s3 = rmsbf4(blk + 12) ^ k[3];
+
+  for (int r = 1; r < 10; r++) {
+    k += 4;
+    uint32_t t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xff] ^ te[2][(s2 >> 8) & 0xff] ^ te[3][s3 & 0xff] ^ k[0];
+    uint32_t t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xff] ^ te[2][(s3 >> 8) & 0xff] ^ te[3][s0 & 0xff] ^ k[1];
+    uint32_t t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xff] ^ te[2][(s0 >> 8) & 0xff] ^ te[3][s1 & 0xff] ^ k[2];
+    uint32_t t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xff] ^ te[2][(s1 >> 8) & 0xff] ^ te[3][s2 & 0xff] ^ k[3];
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
+  }
+
+  /* last round without MixColumns */
+  k += 4;
+  uint32_t s[4] = {s0, s1, s2, s3};
+  for (int c = 0; c < 4; c++) {
+    uint32_t v = ((uint32_t)sbox[s[c] >> 24] << 24) | ((uint32_t)sbox[(s[(c + 1) & 3] >> 16) & 0xff] << 16) |
+                 ((uint32_t)sbox[(s[(c + 2) & 3] >> 8) & 0xff] << 8) | sbox[s[(c + 3) & 3] & 0xff];
+    wmsbf4(blk + 4 * c, v ^ k[c]);
+  }
+}
+
+#if defined(AES_BATCH_X86)
+/* Four blocks in flight hide the latency of AESENC */
+__attribute__((target("aes,sse2"))) static void encrypt_hw(const aes_batch_key_t *const *key, uint8_t (*blk)[16],
+                                                           size_t n)
+{
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const uint8_t *k0 = key[i]->rk, *k1 = key[i + 1]->rk, *k2 = key[i + 2]->rk, *k3 = key[i + 3]->rk;
+    __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blk[i]), _mm_loadu_si128((const __m128i *)k0));
+    __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blk[i + 1]), _mm_loadu_si128((const __m128i *)k1));
+    __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blk[i + 2]), _mm_loadu_si128((const __m128i *)k2));
+    __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blk[i + 3]), _mm_loadu_si128((const __m128i *)k3));
+    for (int r = 1; r < 10; r++) {
+      b0 = _mm_aesenc_si128(b0, _mm_loadu_si128((const __m128i *)(k0 + 16 * r)));
+      b1 = _mm_aesenc_si128(b1, _mm_loadu_si128((const __m128i *)(k1 + 16 * r)));
+      b2 = _mm_aesenc_si128(b2, _mm_loadu_si128((const __m128i *)(k2 + 16 * r)));
+      b3 = _mm_aesenc_si128(b3, _mm_loadu_si128((const __m128i *)(k3 + 16 * r)));
+    }
+    _mm_storeu_si128((__m128i *)blk[i], _mm_aesenclast_si128(b0, _mm_loadu_si128((const __m128i *)(k0 + 160))));
+    _mm_storeu_si128((__m128i *)blk[i + 1], _mm_aesenclast_si128(b1, _mm_loadu_si128((const __m128i *)(k1 + 160))));
+    _mm_storeu_si128((__m128i *)blk[i + 2], _mm_aesenclast_si128(b2, _mm_loadu_si128((const __m128i *)(k2 + 160))));
+    _mm_storeu_si128((__m128i *)blk[i + 3], _mm_aesenclast_si128(b3, _mm_loadu_si128((const __m128i *)(k3 + 160))));
+  }
+  for (; i < n; i++) {
+    const uint8_t *k = key[i]->rk;
+    __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blk[i]), _mm_loadu_si128((const __m128i *)k));
+    for (int r = 1; r < 10; r++)
+      b = _mm_aesenc_si128(b, _mm_loadu_si128((const __m128i *)(k + 16 * r)));
+    _mm_storeu_si128((__m128i *)blk[i], _mm_aesenclast_si128(b, _mm_loadu_si128((const __m128i *)(k + 160))));
+  }
+}
+#endif
+
+void aes_batch_encrypt(const aes_batch_key_t *const *key, uint8_t (*blk)[16], size_t n)
+{
+#if defined(AES_BATCH_X86)
+  if (use_hw) {
+    encrypt_hw(key, blk, n);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; i++)
+    encrypt_tables(key[i], blk[i]);
+}
+
+void aes_batch_encrypt1(const aes_batch_key_t *key, uint8_t blk[16]) { aes_batch_encrypt(&key, (uint8_t(*)[16])blk, 1); }
+
+bool aes_batch_hw() { return use_hw; }
+
+void aes_batch_use_hw(bool enable)
+{
+#if defined(AES_BATCH_X86)
+  use_hw = enable && __builtin_cpu_supports("aes");
+#else
+  (void)enable;
+#endif
+}
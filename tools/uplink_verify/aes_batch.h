@@ -0,0 +1,34 @@
+#ifndef AES_BATCH_H
+#define AES_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * AES-128 encryption of many independent blocks, each with its own key.
+ *
+ * Keys are expanded once with aes_batch_key(). aes_batch_encrypt() then
+ * encrypts a whole array of blocks, interleaving four blocks at a time
+ * with AES-NI when the CPU has it, or with 32-bit T-tables otherwise.
+ */
+
+typedef struct {
+  uint8_t rk[11 * 16]; /* round keys in FIPS-197 byte order (AES-NI) */
+  uint32_t ek[11 * 4]; /* the same as big endian words (T-tables) */
+} aes_batch_key_t;
+
+void aes_batch_key(aes_batch_key_t *key, const uint8_t k[16]);
+
+/* Encrypt blk[i] in place with key[i], for i < n */
+void aes_batch_encrypt(const aes_batch_key_t *const *key, uint8_t (*blk)[16], size_t n);
+
+/* Encrypt a single block */
+void aes_batch_encrypt1(const aes_batch_key_t *key, uint8_t blk[16]);
+
+/* True when aes_batch_encrypt uses AES-NI */
+bool aes_batch_hw();
+
+/* Force the portable T-table code, e.g. to compare both */
+void aes_batch_use_hw(bool enable);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef LMIC_FRAMES_H
+#define LMIC_FRAMES_H
+
+// Uplinks as LMIC on the node builds them (aes/other.c),
+// DevAddr 0x26011BDA, NwkSKey 2B7E1516..., AppSKey 00010203...
+// clang-format off
+static const uint8_t lmic_nwkskey[16] = {
+  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+static const uint8_t lmic_appskey[16] = {
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+static const struct {
+  uint32_t fcnt;
+  int port;
+  uint8_t plen;
+  uint8_t payload[MAX_LEN_PAYLOAD];
+  uint8_t frame[MAX_LEN_FRAME];
+  uint8_t len;
+} lmic_frames[] = {
+  { 1, 1, 12, {0x03, 0x0a, 0x11, 0x18, 0x1f, 0x26, 0x2d, 0x34, 0x3b, 0x42, 0x49, 0x50},
+    {0x40, 0xda, 0x1b, 0x01, 0x26, 0x00, 0x01, 0x00, 0x01, 0xd1, 0xf9, 0xb5,
+     0x84, 0x8c, 0x87, 0x86, 0xf3, 0xa8, 0xd9, 0x33, 0x2d, 0x31, 0x05, 0xa2,
+     0xd1}, 25 },
+  { 2, 2, 40, {0x03, 0x0a, 0x11, 0x18, 0x1f, 0x26, 0x2d, 0x34, 0x3b, 0x42, 0x49, 0x50,
+     0x57, 0x5e, 0x65, 0x6c, 0x73, 0x7a, 0x81, 0x88, 0x8f, 0x96, 0x9d, 0xa4,
+     0xab, 0xb2, 0xb9, 0xc0, 0xc7, 0xce, 0xd5, 0xdc, 0xe3, 0xea, 0xf1, 0xf8,
+     0xff, 0x06, 0x0d, 0x14},
+    {0x40, 0xda, 0x1b, 0x01, 0x26, 0x80, 0x02, 0x00, 0x02, 0x1b, 0xc4, 0xfd,
+     0xda, 0x14, 0xad, 0xdc, 0x0d, 0x4a, 0x86, 0xe1, 0x0f, 0xb6, 0xfc, 0x70,
+     0x09, 0x5c, 0x62, 0x6d, 0x42, 0xb7, 0xeb, 0x37, 0x7b, 0x6a, 0x55, 0x1f,
+     0x7b, 0x1c, 0x17, 0x3d, 0x4f, 0x00, 0xbe, 0xd8, 0x86, 0x42, 0x1a, 0x16,
+     0x6e, 0xb1, 0x2b, 0x3f, 0x39}, 53 },
+  { 74565, 1, 17, {0x03, 0x0a, 0x11, 0x18, 0x1f, 0x26, 0x2d, 0x34, 0x3b, 0x42, 0x49, 0x50,
+     0x57, 0x5e, 0x65, 0x6c, 0x73},
+    {0x80, 0xda, 0x1b, 0x01, 0x26, 0x03, 0x45, 0x23, 0x02, 0x06, 0x00, 0x01,
+     0xe8, 0xc6, 0x9b, 0x63, 0xab, 0x95, 0x74, 0x21, 0x47, 0xa8, 0x60, 0x47,
+     0xf9, 0xaf, 0x15, 0xf8, 0x9f, 0x0c, 0x94, 0xc6, 0x44}, 33 },
+  { 7, 0, 2, {0x03, 0x07},
+    {0x40, 0xda, 0x1b, 0x01, 0x26, 0x00, 0x07, 0x00, 0x00, 0xa6, 0x49, 0x86,
+     0x53, 0xf3, 0x1d}, 15 },
+  { 8, -1, 0, {},
+    {0x40, 0xda, 0x1b, 0x01, 0x26, 0x20, 0x08, 0x00, 0x53, 0xd7, 0x34, 0xca}, 12 },
+};
+// clang-format on
+
+#endif
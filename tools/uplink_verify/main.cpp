@@ -0,0 +1,119 @@
+#include "uplink_verify.h"
+#include "lmic_frames.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define NUM_DEVICES 5000
+#define NUM_FRAMES 2000000
+/* every BAD_EVERY-th frame gets a broken MIC */
+#define BAD_EVERY 100
+
+/* Verify and decrypt the frames LMIC built, and build them again */
+static int check_lmic_frames()
+{
+  int errors = 0;
+  uv_session_t sess;
+  uv_session(&sess, 0x26011BDA, lmic_nwkskey, lmic_appskey);
+
+  for (auto &v : lmic_frames) {
+    uv_frame_t f;
+    memcpy(f.data, v.frame, v.len);
+    f.len = v.len;
+    sess.fcntHigh = v.fcnt >> 16;
+    f.sess = &sess;
+    uv_verify(&f, 1);
+    if (f.status != UV_OK || f.fcnt != v.fcnt || f.port != v.port || f.plen != v.plen ||
+        memcmp(f.data + f.poff, v.payload, v.plen) != 0) {
+      printf("fcnt %u: verify failed, status %d\n", (unsigned)v.fcnt, f.status);
+      errors++;
+    }
+
+    uint8_t frame[MAX_LEN_FRAME];
+    uint8_t fctrl = v.frame[OFF_DAT_FCT];
+    uint8_t len = uv_seal(frame, &sess, v.frame[OFF_DAT_HDR], v.fcnt, fctrl, v.frame + OFF_DAT_OPTS, v.port,
+                          v.payload, v.plen);
+    if (len != v.len || memcmp(frame, v.frame, len) != 0) {
+      printf("fcnt %u: seal differs\n", (unsigned)v.fcnt);
+      errors++;
+    }
+
+    // any flipped bit must fail the MIC
+    memcpy(f.data, v.frame, v.len);
+    f.data[v.len / 2] ^= 0x04;
+    uv_verify(&f, 1);
+    if (f.status != UV_BAD_MIC) {
+      printf("fcnt %u: corrupted frame passed\n", (unsigned)v.fcnt);
+      errors++;
+    }
+  }
+  printf("%d LMIC frames checked, %d errors\n", (int)(sizeof(lmic_frames) / sizeof(lmic_frames[0])), errors);
+  return errors;
+}
+
+static void bench(ThreadPool &pool, const std::vector<uv_frame_t> &traffic, size_t expectBad)
+{
+  std::vector<uv_frame_t> frames(traffic);
+
+  auto start = std::chrono::steady_clock::now();
+  uv_verify_batch(pool, frames.data(), frames.size());
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+
+  size_t bad = 0;
+  for (auto &f : frames)
+    bad += f.status != UV_OK;
+  printf("%-7s %2u threads: %6.0f ms, %5.1f M frames/min%s\n", aes_batch_hw() ? "AES-NI" : "tables", pool.size(),
+         d.count() * 1000, frames.size() / d.count() * 60 / 1e6, bad == expectBad ? "" : " (WRONG RESULT)");
+}
+
+int main(int argc, char **argv)
+{
+  size_t numFrames = argc > 1 ? atol(argv[1]) : NUM_FRAMES;
+  if (check_lmic_frames())
+    return 1;
+
+  // one session per device with random keys, and random uplinks
+  std::vector<uv_session_t> sessions(NUM_DEVICES);
+  srand(1);
+  for (size_t i = 0; i < sessions.size(); i++) {
+    uint8_t nwk[16], app[16];
+    for (int k = 0; k < 16; k++) {
+      nwk[k] = rand();
+      app[k] = rand();
+    }
+    uv_session(&sessions[i], 0x26000000 + i, nwk, app);
+  }
+
+  std::vector<uv_frame_t> traffic(numFrames);
+  size_t bad = 0;
+  for (size_t i = 0; i < traffic.size(); i++) {
+    uv_frame_t &f = traffic[i];
+    uint8_t payload[MAX_LEN_PAYLOAD];
+    uint8_t plen = 8 + rand() % 40;
+    for (int k = 0; k < plen; k++)
+      payload[k] = rand();
+    f.sess = &sessions[rand() % sessions.size()];
+    f.len = uv_seal(f.data, f.sess, HDR_FTYPE_DAUP | HDR_MAJOR_V1, i & 0xFFFF, 0, NULL, 1 + rand() % 8, payload, plen);
+    if (i % BAD_EVERY == 0) {
+      f.data[f.len - 1] ^= 1;
+      bad++;
+    }
+  }
+  printf("%u frames of %u devices\n", (unsigned)traffic.size(), (unsigned)sessions.size());
+
+  unsigned threads = std::thread::hardware_concurrency();
+  bool hw = aes_batch_hw();
+  for (int tables = 0; tables <= (hw ? 1 : 0); tables++) {
+    aes_batch_use_hw(!tables);
+    {
+      ThreadPool one(1);
+      bench(one, traffic, bad);
+    }
+    if (threads > 1) {
+      ThreadPool all(threads);
+      bench(all, traffic, bad);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,4 @@
+#!/bin/sh
+
+pio run
+./.pio/build/native/program "$@"
@@ -0,0 +1,105 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads that split a range of work items between
+ * them. The calling thread works along, so a pool of one thread runs
+ * everything on the caller.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency())
+  {
+    if (threads == 0)
+      threads = 1;
+    for (unsigned i = 1; i < threads; i++)
+      workers.emplace_back([this] { work(); });
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      quit = true;
+    }
+    wake.notify_all();
+    for (auto &t : workers)
+      t.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  unsigned size() const { return workers.size() + 1; }
+
+  /* Call fn(begin, end) on chunks of [0, n) until all are done */
+  void run(size_t n, size_t chunk, const std::function<void(size_t, size_t)> &fn)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &fn;
+      jobSize = n;
+      jobChunk = chunk ? chunk : 1;
+      next = 0;
+      busy = workers.size();
+      generation++;
+    }
+    wake.notify_all();
+    chunks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    job = nullptr;
+  }
+
+private:
+  void chunks()
+  {
+    for (;;) {
+      size_t begin = next.fetch_add(jobChunk);
+      if (begin >= jobSize)
+        return;
+      size_t end = begin + jobChunk < jobSize ? begin + jobChunk : jobSize;
+      (*job)(begin, end);
+    }
+  }
+
+  void work()
+  {
+    unsigned seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return quit || generation != seen; });
+        if (quit)
+          return;
+        seen = generation;
+      }
+      chunks();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        busy--;
+      }
+      done.notify_one();
+    }
+  }
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake, done;
+  const std::function<void(size_t, size_t)> *job = nullptr;
+  size_t jobSize = 0, jobChunk = 1;
+  std::atomic<size_t> next{0};
+  size_t busy = 0;
+  unsigned generation = 0;
+  bool quit = false;
+};
+
+#endif
@@ -0,0 +1,251 @@
+#include "uplink_verify.h"
+#include <string.h>
+
+/* Frames worked on side by side, so the AES kernel gets several blocks */
+#define LANES 8
+/* Frames per thread pool work item */
+#define CHUNK 256
+
+#define MAX_CTR_BLOCKS ((MAX_LEN_PAYLOAD + 15) / 16)
+
+static uint32_t rlsbf4(const uint8_t *b)
+{
+  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static void wlsbf4(uint8_t *b, uint32_t v)
+{
+  b[0] = v;
+  b[1] = v >> 8;
+  b[2] = v >> 16;
+  b[3] = v >> 24;
+}
+
+/* Multiply by x in GF(2^128), for the CMAC subkeys (RFC 4493) */
+static void cmac_double(uint8_t *dst, const uint8_t *src)
+{
+  uint8_t carry = 0;
+  for (int i = 15; i >= 0; i--) {
+    uint8_t b = src[i];
+    dst[i] = (b << 1) | carry;
+    carry = b >> 7;
+  }
+  if (src[0] & 0x80)
+    dst[15] ^= 0x87;
+}
+
+/* B0 block of the MIC, like micB0() in lmic.c */
+static void micB0(uint8_t *b, uint32_t devaddr, uint32_t fcnt, int dndir, uint8_t len)
+{
+  memset(b, 0, 16);
+  b[0] = 0x49;
+  b[5] = dndir ? 1 : 0;
+  wlsbf4(b + 6, devaddr);
+  wlsbf4(b + 10, fcnt);
+  b[15] = len;
+}
+
+/* Counter block A_i of the payload encryption, like aes_cipher() in lmic.c */
+static void ctrA(uint8_t *b, uint32_t devaddr, uint32_t fcnt, int dndir, uint8_t i)
+{
+  memset(b, 0, 16);
+  b[0] = 1;
+  b[5] = dndir ? 1 : 0;
+  wlsbf4(b + 6, devaddr);
+  wlsbf4(b + 10, fcnt);
+  b[15] = i;
+}
+
+void uv_session(uv_session_t *s, uint32_t devaddr, const uint8_t nwkskey[16], const uint8_t appskey[16])
+{
+  uint8_t l[16];
+  memset(s, 0, sizeof(*s));
+  s->devaddr = devaddr;
+  aes_batch_key(&s->nwk, nwkskey);
+  aes_batch_key(&s->app, appskey);
+  memset(l, 0, sizeof(l));
+  aes_batch_encrypt1(&s->nwk, l);
+  cmac_double(s->k1, l);
+  cmac_double(s->k2, s->k1);
+}
+
+uint32_t uv_devaddr(const uint8_t *data) { return rlsbf4(data + OFF_DAT_ADDR); }
+
+/* Check the header and fill in the layout fields, returns the status */
+static uint8_t parse(uv_frame_t *f)
+{
+  if (f->len < OFF_DAT_OPTS + 4 || f->len > MAX_LEN_FRAME)
+    return UV_BAD_LENGTH;
+  uint8_t ftype = f->data[OFF_DAT_HDR] & HDR_FTYPE;
+  if ((ftype != HDR_FTYPE_DAUP && ftype != HDR_FTYPE_DCUP && ftype != HDR_FTYPE_DADN && ftype != HDR_FTYPE_DCDN) ||
+      (f->data[OFF_DAT_HDR] & HDR_MAJOR) != HDR_MAJOR_V1)
+    return UV_BAD_MHDR;
+
+  uint8_t end = OFF_DAT_OPTS + (f->data[OFF_DAT_FCT] & FCT_OPTLEN);
+  uint8_t mic = f->len - 4;
+  if (end > mic)
+    return UV_BAD_LENGTH;
+  f->fcnt = ((uint32_t)f->sess->fcntHigh << 16) | f->data[OFF_DAT_SEQNO] | (f->data[OFF_DAT_SEQNO + 1] << 8);
+  if (end < mic) {
+    f->port = f->data[end];
+    f->poff = end + 1;
+    f->plen = mic - end - 1;
+  }
+  else {
+    f->port = -1;
+    f->poff = mic;
+    f->plen = 0;
+  }
+  return UV_OK;
+}
+
+/* Up to LANES frames in lock step: one AES block per frame per step */
+static void verify_lanes(uv_frame_t *f, size_t n)
+{
+  uint8_t blk[LANES * MAX_CTR_BLOCKS][16];
+  const aes_batch_key_t *key[LANES * MAX_CTR_BLOCKS];
+  uint8_t mac[LANES][16];
+  uint8_t lane[LANES];
+  uint8_t nblocks[LANES];
+  uint8_t steps = 0;
+
+  // B0 goes first for every frame that parses
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    f[i].status = parse(&f[i]);
+    if (f[i].status != UV_OK)
+      continue;
+    int dndir = f[i].data[OFF_DAT_HDR] & HDR_FTYPE_DNFLAG;
+    uint8_t len = f[i].len - 4;
+    micB0(blk[m], uv_devaddr(f[i].data), f[i].fcnt, dndir, len);
+    key[m] = &f[i].sess->nwk;
+    lane[m] = i;
+    nblocks[i] = (len + 15) / 16;
+    if (nblocks[i] > steps)
+      steps = nblocks[i];
+    m++;
+  }
+  aes_batch_encrypt(key, blk, m);
+  for (size_t j = 0; j < m; j++)
+    memcpy(mac[lane[j]], blk[j], 16);
+
+  // then the message blocks, the last one padded and xored with K1/K2
+  for (uint8_t s = 0; s < steps; s++) {
+    m = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (f[i].status != UV_OK || s >= nblocks[i])
+        continue;
+      uint8_t len = f[i].len - 4;
+      uint8_t off = 16 * s;
+      uint8_t cnt = len - off < 16 ? len - off : 16;
+      for (uint8_t k = 0; k < cnt; k++)
+        mac[i][k] ^= f[i].data[off + k];
+      if (s == nblocks[i] - 1) {
+        const uint8_t *sub = f[i].sess->k1;
+        if (cnt < 16) {
+          mac[i][cnt] ^= 0x80;
+          sub = f[i].sess->k2;
+        }
+        for (uint8_t k = 0; k < 16; k++)
+          mac[i][k] ^= sub[k];
+      }
+      memcpy(blk[m], mac[i], 16);
+      key[m] = &f[i].sess->nwk;
+      lane[m] = i;
+      m++;
+    }
+    aes_batch_encrypt(key, blk, m);
+    for (size_t j = 0; j < m; j++)
+      memcpy(mac[lane[j]], blk[j], 16);
+  }
+
+  // compare the MICs, and collect the key stream blocks of the good frames
+  m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (f[i].status != UV_OK)
+      continue;
+    if (memcmp(mac[i], f[i].data + f[i].len - 4, 4) != 0) {
+      f[i].status = UV_BAD_MIC;
+      continue;
+    }
+    int dndir = f[i].data[OFF_DAT_HDR] & HDR_FTYPE_DNFLAG;
+    const aes_batch_key_t *k = f[i].port == 0 ? &f[i].sess->nwk : &f[i].sess->app;
+    for (uint8_t b = 0; 16 * b < f[i].plen; b++) {
+      ctrA(blk[m], uv_devaddr(f[i].data), f[i].fcnt, dndir, b + 1);
+      key[m] = k;
+      m++;
+    }
+  }
+  aes_batch_encrypt(key, blk, m);
+
+  // and decrypt in the same order
+  m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (f[i].status != UV_OK)
+      continue;
+    for (uint8_t off = 0; off < f[i].plen; off += 16, m++) {
+      uint8_t cnt = f[i].plen - off < 16 ? f[i].plen - off : 16;
+      for (uint8_t k = 0; k < cnt; k++)
+        f[i].data[f[i].poff + off + k] ^= blk[m][k];
+    }
+  }
+}
+
+void uv_verify(uv_frame_t *frames, size_t n)
+{
+  for (size_t i = 0; i < n; i += LANES)
+    verify_lanes(frames + i, n - i < LANES ? n - i : LANES);
+}
+
+void uv_verify_batch(ThreadPool &pool, uv_frame_t *frames, size_t n)
+{
+  pool.run(n, CHUNK, [frames](size_t begin, size_t end) { uv_verify(frames + begin, end - begin); });
+}
+
+uint8_t uv_seal(uint8_t *frame, const uv_session_t *s, uint8_t mhdr, uint32_t fcnt, uint8_t fctrl,
+                const uint8_t *fopts, int port, const uint8_t *payload, uint8_t plen)
+{
+  uint8_t end = OFF_DAT_OPTS + (fctrl & FCT_OPTLEN);
+  uint8_t len = end + (port >= 0 ? 1 + plen : 0);
+  int dndir = mhdr & HDR_FTYPE_DNFLAG;
+  uint8_t b[16];
+
+  frame[OFF_DAT_HDR] = mhdr;
+  wlsbf4(frame + OFF_DAT_ADDR, s->devaddr);
+  frame[OFF_DAT_FCT] = fctrl;
+  frame[OFF_DAT_SEQNO] = fcnt;
+  frame[OFF_DAT_SEQNO + 1] = fcnt >> 8;
+  memcpy(frame + OFF_DAT_OPTS, fopts, fctrl & FCT_OPTLEN);
+
+  if (port >= 0) {
+    frame[end] = port;
+    for (uint8_t off = 0; off < plen; off += 16) {
+      ctrA(b, s->devaddr, fcnt, dndir, off / 16 + 1);
+      aes_batch_encrypt1(port == 0 ? &s->nwk : &s->app, b);
+      for (uint8_t k = 0; k < 16 && off + k < plen; k++)
+        frame[end + 1 + off + k] = payload[off + k] ^ b[k];
+    }
+  }
+
+  // plain CMAC over B0 and the frame
+  uint8_t mac[16];
+  micB0(mac, s->devaddr, fcnt, dndir, len);
+  aes_batch_encrypt1(&s->nwk, mac);
+  for (uint8_t off = 0; off < len; off += 16) {
+    uint8_t cnt = len - off < 16 ? len - off : 16;
+    for (uint8_t k = 0; k < cnt; k++)
+      mac[k] ^= frame[off + k];
+    if (off + 16 >= len) {
+      const uint8_t *sub = s->k1;
+      if (cnt < 16) {
+        mac[cnt] ^= 0x80;
+        sub = s->k2;
+      }
+      for (uint8_t k = 0; k < 16; k++)
+        mac[k] ^= sub[k];
+    }
+    aes_batch_encrypt1(&s->nwk, mac);
+  }
+  memcpy(frame + len, mac, 4);
+  return len + 4;
+}
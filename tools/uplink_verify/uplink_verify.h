@@ -0,0 +1,66 @@
+#ifndef UPLINK_VERIFY_H
+#define UPLINK_VERIFY_H
+
+#include "aes_batch.h"
+#include "thread_pool.h"
+
+// LMIC's own definitions of the frame layout (OFF_DAT_*, HDR_*, FCT_*)
+#include "oslmic.h"
+#include "lorabase.h"
+
+/*
+ * Network server side of LMIC's data frames: check the MIC and decrypt
+ * the payload of many frames at once, the reverse of what buildDataFrame()
+ * in lmic.c does on the node.
+ */
+
+/* Session keys of one device, as the network server knows them */
+typedef struct {
+  uint32_t devaddr;
+  uint16_t fcntHigh;   /* upper half of the 32-bit frame counter */
+  aes_batch_key_t nwk; /* NwkSKey, for the MIC and port 0 payloads */
+  aes_batch_key_t app; /* AppSKey, for all other payloads */
+  uint8_t k1[16];      /* CMAC subkeys of NwkSKey */
+  uint8_t k2[16];
+} uv_session_t;
+
+void uv_session(uv_session_t *s, uint32_t devaddr, const uint8_t nwkskey[16], const uint8_t appskey[16]);
+
+enum {
+  UV_OK = 0,
+  UV_BAD_LENGTH, /* too short, or FOpts run into the MIC */
+  UV_BAD_MHDR,   /* not a LoRaWAN 1.0 data frame */
+  UV_BAD_MIC,
+};
+
+typedef struct {
+  uint8_t data[MAX_LEN_FRAME]; /* PHYPayload, FRMPayload is decrypted in place */
+  uint8_t len;
+  const uv_session_t *sess; /* looked up by the caller, see uv_devaddr() */
+
+  // results
+  uint8_t status;
+  int16_t port;  /* -1 for frames without FPort */
+  uint8_t poff;  /* FRMPayload starts at data[poff] */
+  uint8_t plen;
+  uint32_t fcnt; /* full frame counter */
+} uv_frame_t;
+
+/* DevAddr of a data frame, for finding its session */
+uint32_t uv_devaddr(const uint8_t *data);
+
+/* Check and decrypt n frames on the calling thread */
+void uv_verify(uv_frame_t *frames, size_t n);
+
+/* Check and decrypt n frames on all threads of the pool */
+void uv_verify_batch(ThreadPool &pool, uv_frame_t *frames, size_t n);
+
+/*
+ * Build a data frame the way the node does: MHDR and FHDR from the
+ * arguments, then FPort and the encrypted payload (if port >= 0), then
+ * the MIC. Returns the frame length. For generating test traffic.
+ */
+uint8_t uv_seal(uint8_t *frame, const uv_session_t *s, uint8_t mhdr, uint32_t fcnt, uint8_t fctrl,
+                const uint8_t *fopts, int port, const uint8_t *payload, uint8_t plen);
+
+#endif